@@ -0,0 +1,122 @@
+/*
+ * PackageLicenseDeclared: Apache-2.0
+ * Copyright (c) 2019 Renesas Electronics Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _ESP32AT_AD_PARSER_H_
+#define _ESP32AT_AD_PARSER_H_
+
+#include <stdint.h>
+#include "platform/Span.h"
+
+namespace ble {
+namespace atcmd {
+
+/**
+ * Iterator over the AD structures of an advertising or scan response
+ * payload (length, type, value).
+ *
+ * Fields are returned as views into the payload; nothing is copied or
+ * allocated. A field whose length runs past the end of the payload stops
+ * the iteration and marks the payload as malformed. A zero length octet
+ * ends the significant part of the payload.
+ */
+class Esp32AtAdParser {
+public:
+    typedef struct {
+        uint8_t                   type;
+        mbed::Span<const uint8_t> value;
+    } ad_field_t;
+
+    Esp32AtAdParser(mbed::Span<const uint8_t> payload) :
+        _payload(payload), _pos(0), _malformed(false) {
+    }
+
+    /**
+     * Get the next field.
+     *
+     * @return false at the end of the payload or on a malformed field.
+     */
+    bool next(ad_field_t * p_field) {
+        if ((_pos >= _payload.size()) || _malformed) {
+            return false;
+        }
+
+        ptrdiff_t len = _payload[_pos];
+
+        if (len == 0) {
+            _pos = _payload.size();
+            return false;
+        }
+        if ((_payload.size() - _pos - 1) < len) {
+            _malformed = true;
+            return false;
+        }
+
+        p_field->type  = _payload[_pos + 1];
+        p_field->value = _payload.subspan(_pos + 2, len - 1);
+        _pos += len + 1;
+
+        return true;
+    }
+
+    /**
+     * Whether iteration stopped on a field exceeding the payload.
+     */
+    bool isMalformed(void) const {
+        return _malformed;
+    }
+
+    void reset(void) {
+        _pos       = 0;
+        _malformed = false;
+    }
+
+    /**
+     * Find the first field of a type.
+     */
+    static bool find(mbed::Span<const uint8_t> payload, uint8_t type, ad_field_t * p_field) {
+        Esp32AtAdParser parser(payload);
+
+        while (parser.next(p_field)) {
+            if (p_field->type == type) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /**
+     * Check a payload for fields exceeding its end.
+     */
+    static bool isValid(mbed::Span<const uint8_t> payload) {
+        Esp32AtAdParser parser(payload);
+        ad_field_t field;
+
+        while (parser.next(&field)) {
+        }
+        return !parser.isMalformed();
+    }
+
+private:
+    mbed::Span<const uint8_t> _payload;
+    ptrdiff_t                 _pos;
+    bool                      _malformed;
+};
+
+} // namespace atcmd
+} // namespace ble
+
+#endif /* _ESP32AT_AD_PARSER_H_ */
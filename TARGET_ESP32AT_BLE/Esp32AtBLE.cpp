@@ -23,6 +23,12 @@ BLEInstanceBase *createBLEInstance(void)
     return (&ble::Esp32AtBLE::deviceInstance());
 }
 
+MBED_STATIC_ASSERT((ESP32AT_BLE_EVENT_QUE_SIZE & (ESP32AT_BLE_EVENT_QUE_SIZE - 1)) == 0,
+                   "ESP32AT_BLE_EVENT_QUE_SIZE must be a power of two");
+
+#define EVENT_FLAG_PROCESS      (1UL << 0)
+#define EVENT_FLAG_STOP         (1UL << 1)
+
 namespace ble {
 
 Esp32AtBLE& Esp32AtBLE::deviceInstance()
@@ -31,25 +37,42 @@ Esp32AtBLE& Esp32AtBLE::deviceInstance()
     return instance;
 }
 
-Esp32AtBLE::Esp32AtBLE(void) : initialized(false), instanceID(BLE::DEFAULT_INSTANCE), p_event_flg(NULL), _event_que_top(NULL)
+Esp32AtBLE::Esp32AtBLE(void) : initialized(false), instanceID(BLE::DEFAULT_INSTANCE),
+    _timer_wheel(callback(this, &Esp32AtBLE::timerTick)),
+    _dispatcher(NULL), _dispatch_queue(NULL), _dispatch_posted(false),
+    _sigio_pending(true),
+    _drain_max_events(ESP32AT_BLE_DRAIN_MAX_EVENTS), _drain_max_time_us(ESP32AT_BLE_DRAIN_MAX_TIME_US),
+    _drain_count(0)
 {
     _esp = ESP32::getESP32Inst();
+    for (int i = 0; i < EVENT_PRIO_NUM; i++) {
+        _event_que_head[i] = 0;
+        _event_que_tail[i] = 0;
+        _event_que_skip[i] = 0;
+    }
+    resetEventStats();
 }
 
 Esp32AtBLE::~Esp32AtBLE(void)
 {
-    if (p_event_flg) {
-        delete p_event_flg;
-    }
+    stopDispatcher();
 }
 
 const char *Esp32AtBLE::getVersion(void)
 {
-    static char versionString[256];
+    static char versionString[ESP32AT_BLE_SHADOW_VERSION_SIZE];
+    atcmd::Esp32AtModemShadow &shadow = atcmd::Esp32AtModemShadow::getInstance();
+    const char * p_version = (const char *)shadow.get(SHADOW_VERSION);
 
-    if (!_esp->get_version_info(versionString, 256)) {
+    if (p_version != NULL) {
+        return p_version;
+    }
+
+    if (!_esp->get_version_info(versionString, sizeof(versionString))) {
         strncpy(versionString, "unknown", sizeof("unknown"));
+        return versionString;
     }
+    shadow.update(SHADOW_VERSION, versionString, strlen(versionString) + 1);
 
     return versionString;
 }
@@ -63,6 +86,7 @@ ble_error_t Esp32AtBLE::init(
         BLE::Instance(instanceID),
         BLE_ERROR_NONE
     };
+    getGap(); /* attaches the modem SIGIO handler */
     initCallback.call(&context);
     initialized = true;
     return BLE_ERROR_NONE;
@@ -75,83 +99,336 @@ ble_error_t Esp32AtBLE::shutdown(void)
 
 void Esp32AtBLE::waitForEvent(void)
 {
-    if (p_event_flg == NULL) {
-        p_event_flg = new EventFlags;
-    }
     processEvents();
-    if (p_event_flg) {
-        p_event_flg->wait_all(1);
-    }
+    _event_flg.wait_all(EVENT_FLAG_PROCESS);
 }
 
 void Esp32AtBLE::processEvents()
 {
-    EventQue_t * p_event;
+    EventQue_t event;
+    uint32_t start_us = us_ticker_read();
+
+    _drain_count = 0;
+
+    if (_sigio_pending) {
+        _sigio_pending = false;
+        _esp->ble_process_oob(1, true);
+    }
+
+    while (getEvent(&event)) {
+#if ESP32AT_BLE_EVENT_STATS
+        uint32_t dispatch_us = us_ticker_read();
+#endif
+        switch (event.type) {
+            case EVENT_TYPE_COMMON:
+                getGap().doEvent(event.id, event.arg);
+                break;
+            case EVENT_TYPE_SERVER:
+                getGattServer().doEvent(event.id, event.arg);
+                break;
+            case EVENT_TYPE_CLIENT:
+                getGattClient().doEvent(event.id, event.arg);
+                break;
+            case EVENT_TYPE_TIMER:
+                _timer_wheel.process();
+                break;
+            default:
+                break;
+        }
+#if ESP32AT_BLE_EVENT_STATS
+        if (event.type < EVENT_TYPE_NUM) {
+            uint32_t latency_us = dispatch_us - event.enqueue_us;
+            uint32_t handler_us = us_ticker_read() - dispatch_us;
+            event_stats_t * p_stats = &_event_stats[event.type];
+            uint32_t bucket = 0;
+
+            while ((bucket < (ESP32AT_BLE_EVENT_STATS_BUCKETS - 1)) && (latency_us >= (64UL << bucket))) {
+                bucket++;
+            }
+
+            core_util_critical_section_enter();
+            p_stats->dispatched++;
+            p_stats->latency_total_us += latency_us;
+            if (latency_us > p_stats->latency_max_us) {
+                p_stats->latency_max_us = latency_us;
+            }
+            p_stats->latency_hist[bucket]++;
+            p_stats->handler_total_us += handler_us;
+            if (handler_us > p_stats->handler_max_us) {
+                p_stats->handler_max_us = handler_us;
+            }
+            core_util_critical_section_exit();
+        }
+#endif
+        _drain_count++;
+
+        if ((_drain_max_events != 0) && (_drain_count >= _drain_max_events)) {
+            break;
+        }
+        if ((_drain_max_time_us != 0) && ((us_ticker_read() - start_us) >= _drain_max_time_us)) {
+            break;
+        }
+    }
+
+    /* Budget exhausted with work left: ask to be called again. */
+    if (hasEvent()) {
+        signalEventsToProcess(::BLE::DEFAULT_INSTANCE);
+    }
+}
+
+void Esp32AtBLE::setDrainBudget(uint32_t max_events, uint32_t max_time_us)
+{
+    _drain_max_events  = max_events;
+    _drain_max_time_us = max_time_us;
+}
+
+ble_error_t Esp32AtBLE::startDispatcher(events::EventQueue * queue, osPriority priority, uint32_t stack_size)
+{
+    if (_dispatcher != NULL) {
+        return BLE_ERROR_INVALID_STATE;
+    }
+
+    _dispatcher = new Thread(priority, stack_size, NULL, "esp32at_ble");
+    if (_dispatcher == NULL) {
+        return BLE_ERROR_NO_MEM;
+    }
 
-    _esp->ble_process_oob(1, false);
+    _dispatch_queue  = queue;
+    _dispatch_posted = false;
+    _event_flg.clear(EVENT_FLAG_STOP);
+    if (_dispatcher->start(callback(this, &Esp32AtBLE::dispatcherMain)) != osOK) {
+        delete _dispatcher;
+        _dispatcher = NULL;
+        _dispatch_queue = NULL;
+        return BLE_ERROR_NO_MEM;
+    }
+
+    /* Pick up anything queued before the dispatcher existed. */
+    _event_flg.set(EVENT_FLAG_PROCESS);
 
-    p_event = _event_que_top;
-    if (p_event == NULL) {
+    return BLE_ERROR_NONE;
+}
+
+void Esp32AtBLE::stopDispatcher(void)
+{
+    if (_dispatcher == NULL) {
         return;
     }
-    core_util_critical_section_enter();
-    _event_que_top = p_event->p_next;
-    core_util_critical_section_exit();
 
-    switch (p_event->type) {
-        case EVENT_TYPE_COMMON:
-            getGap().doEvent(p_event->id, p_event->arg);
+    _event_flg.set(EVENT_FLAG_STOP);
+    _dispatcher->join();
+    delete _dispatcher;
+    _dispatcher = NULL;
+    _dispatch_queue = NULL;
+
+    /* Hand any remaining work back to the application. */
+    signalEventsToProcess(::BLE::DEFAULT_INSTANCE);
+}
+
+void Esp32AtBLE::dispatcherMain(void)
+{
+    uint32_t flags;
+
+    while (true) {
+        flags = _event_flg.wait_any(EVENT_FLAG_PROCESS | EVENT_FLAG_STOP);
+        if (flags & osFlagsError) {
+            continue;
+        }
+        if (flags & EVENT_FLAG_STOP) {
             break;
-        case EVENT_TYPE_SERVER:
-            getGattServer().doEvent(p_event->id, p_event->arg);
+        }
+
+        if (_dispatch_queue == NULL) {
+            processEvents();
+        } else if (!_dispatch_posted) {
+            /* One pass in flight at a time; further signals are picked up
+             * by it or cause a new post once it started. */
+            _dispatch_posted = true;
+            if (_dispatch_queue->call(this, &Esp32AtBLE::dispatchOnQueue) == 0) {
+                /* Queue full: retry shortly rather than lose the signal. */
+                _dispatch_posted = false;
+                ThisThread::sleep_for(1);
+                _event_flg.set(EVENT_FLAG_PROCESS);
+            }
+        }
+    }
+}
+
+void Esp32AtBLE::dispatchOnQueue(void)
+{
+    _dispatch_posted = false;
+    processEvents();
+}
+
+bool Esp32AtBLE::timerTick(void)
+{
+    /* Timeout interrupt: only hand the expiry over to the event queue. */
+    return (setEvent(EVENT_TYPE_TIMER, 0, NULL) == BLE_ERROR_NONE);
+}
+
+void Esp32AtBLE::signalModemData(void)
+{
+    _sigio_pending = true;
+    signalEventsToProcess(::BLE::DEFAULT_INSTANCE);
+}
+
+void Esp32AtBLE::signalEventsToProcess(BLE::InstanceID_t id)
+{
+    _event_flg.set(EVENT_FLAG_PROCESS);
+    if (_dispatcher == NULL) {
+        BLEInstanceBase::signalEventsToProcess(id);
+    }
+}
+
+ble_error_t Esp32AtBLE::setEvent(uint32_t type, uint32_t id, void * arg)
+{
+    uint32_t prio;
+
+    switch (type) {
+        case EVENT_TYPE_COMMON:
+        case EVENT_TYPE_TIMER:
+            prio = EVENT_PRIO_HIGH;
             break;
         case EVENT_TYPE_CLIENT:
-            getGattClient().doEvent(p_event->id, p_event->arg);
+            prio = EVENT_PRIO_LOW;
             break;
         default:
+            prio = EVENT_PRIO_NORMAL;
             break;
     }
 
-    delete p_event;
+    return setEvent(type, id, arg, prio);
 }
 
-void Esp32AtBLE::signalEventsToProcess(BLE::InstanceID_t id)
+ble_error_t Esp32AtBLE::setEvent(uint32_t type, uint32_t id, void * arg, uint32_t prio)
 {
-    if (p_event_flg) {
-        p_event_flg->set(1);
+    EventQue_t * p_new_event;
+
+    if (prio >= EVENT_PRIO_NUM) {
+        return BLE_ERROR_INVALID_PARAM;
+    }
+
+    /* Producers may be threads or interrupt handlers, so the slot
+     * reservation is serialised. The section is constant time. */
+    core_util_critical_section_enter();
+    if ((_event_que_tail[prio] - _event_que_head[prio]) >= ESP32AT_BLE_EVENT_QUE_SIZE) {
+#if ESP32AT_BLE_EVENT_STATS
+        if (type < EVENT_TYPE_NUM) {
+            _event_stats[type].dropped++;
+        }
+#endif
+        core_util_critical_section_exit();
+        return BLE_ERROR_BUFFER_OVERFLOW;
     }
-    BLEInstanceBase::signalEventsToProcess(id);
+    p_new_event = &_event_que[prio][_event_que_tail[prio] & (ESP32AT_BLE_EVENT_QUE_SIZE - 1)];
+    p_new_event->type = type;
+    p_new_event->id   = id;
+    p_new_event->arg  = arg;
+#if ESP32AT_BLE_EVENT_STATS
+    p_new_event->enqueue_us = us_ticker_read();
+#endif
+    _event_que_tail[prio]++;
+#if ESP32AT_BLE_EVENT_STATS
+    if (type < EVENT_TYPE_NUM) {
+        _event_stats[type].enqueued++;
+    }
+    uint32_t queued = 0;
+    for (int i = 0; i < EVENT_PRIO_NUM; i++) {
+        queued += _event_que_tail[i] - _event_que_head[i];
+    }
+    if (queued > _event_que_high_water) {
+        _event_que_high_water = queued;
+    }
+#endif
+    core_util_critical_section_exit();
+
+    signalEventsToProcess(::BLE::DEFAULT_INSTANCE);
+
+    return BLE_ERROR_NONE;
 }
 
-bool Esp32AtBLE::setEvent(uint32_t type, uint32_t id, void * arg)
+bool Esp32AtBLE::getEvent(EventQue_t * p_event)
 {
-    EventQue_t * p_new_event = new EventQue_t;
+    int sel = -1;
+    uint32_t head;
 
-    if (p_new_event == NULL) {
+    for (int i = 0; i < EVENT_PRIO_NUM; i++) {
+        if (_event_que_head[i] == _event_que_tail[i]) {
+            continue;
+        }
+        if (sel < 0) {
+            sel = i;
+        } else if ((ESP32AT_BLE_EVENT_STARVATION_LIMIT != 0)
+                && (_event_que_skip[i] >= ESP32AT_BLE_EVENT_STARVATION_LIMIT)) {
+            /* Lower level was passed over too often: let it run once. */
+            sel = i;
+            break;
+        }
+    }
+    if (sel < 0) {
         return false;
     }
 
-    p_new_event->type   = type;
-    p_new_event->id     = id;
-    p_new_event->arg    = arg;
-    p_new_event->p_next = NULL;
+    for (int i = 0; i < EVENT_PRIO_NUM; i++) {
+        if (i == sel) {
+            _event_que_skip[i] = 0;
+        } else if (_event_que_head[i] != _event_que_tail[i]) {
+            _event_que_skip[i]++;
+        }
+    }
 
-    core_util_critical_section_enter();
-    if (_event_que_top == NULL) {
-        _event_que_top = p_new_event;
-    } else {
-        EventQue_t * p_wk_event = _event_que_top;
+    /* Copy the slot out before releasing it to the producer. */
+    head = _event_que_head[sel];
+    *p_event = _event_que[sel][head & (ESP32AT_BLE_EVENT_QUE_SIZE - 1)];
+    _event_que_head[sel] = head + 1;
 
-        while (p_wk_event->p_next != NULL) {
-            p_wk_event  = p_wk_event->p_next;
+    return true;
+}
+
+bool Esp32AtBLE::hasEvent(void) const
+{
+    for (int i = 0; i < EVENT_PRIO_NUM; i++) {
+        if (_event_que_head[i] != _event_que_tail[i]) {
+            return true;
         }
-        p_wk_event->p_next = p_new_event;
     }
+    return false;
+}
+
+ble_error_t Esp32AtBLE::getEventStats(uint32_t type, event_stats_t * p_stats) const
+{
+#if ESP32AT_BLE_EVENT_STATS
+    if ((type >= EVENT_TYPE_NUM) || (p_stats == NULL)) {
+        return BLE_ERROR_INVALID_PARAM;
+    }
+
+    core_util_critical_section_enter();
+    *p_stats = _event_stats[type];
     core_util_critical_section_exit();
 
-    signalEventsToProcess(::BLE::DEFAULT_INSTANCE);
+    return BLE_ERROR_NONE;
+#else
+    return BLE_ERROR_NOT_IMPLEMENTED;
+#endif
+}
 
-    return true;
+uint32_t Esp32AtBLE::getEventQueueHighWater(void) const
+{
+#if ESP32AT_BLE_EVENT_STATS
+    return _event_que_high_water;
+#else
+    return 0;
+#endif
+}
+
+void Esp32AtBLE::resetEventStats(void)
+{
+#if ESP32AT_BLE_EVENT_STATS
+    core_util_critical_section_enter();
+    memset(_event_stats, 0, sizeof(_event_stats));
+    _event_que_high_water = 0;
+    core_util_critical_section_exit();
+#endif
 }
 
 } // namespace ble
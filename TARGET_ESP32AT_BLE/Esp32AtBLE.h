@@ -25,8 +25,42 @@
 #include "Esp32AtGattClient.h"
 #include "Esp32AtGattServer.h"
 #include "Esp32AtSecurityManager.h"
+#include "Esp32AtTimerWheel.h"
 
 #include "ESP32.h"
+#include "events/EventQueue.h"
+
+#ifndef ESP32AT_BLE_EVENT_QUE_SIZE
+#define ESP32AT_BLE_EVENT_QUE_SIZE  32  /* per priority level, must be a power of two */
+#endif
+
+#ifndef ESP32AT_BLE_EVENT_STARVATION_LIMIT
+#define ESP32AT_BLE_EVENT_STARVATION_LIMIT  8   /* 0: strict priority */
+#endif
+
+#ifndef ESP32AT_BLE_DRAIN_MAX_EVENTS
+#define ESP32AT_BLE_DRAIN_MAX_EVENTS 1  /* 0: no limit */
+#endif
+
+#ifndef ESP32AT_BLE_DRAIN_MAX_TIME_US
+#define ESP32AT_BLE_DRAIN_MAX_TIME_US 0 /* 0: no limit */
+#endif
+
+#ifndef ESP32AT_BLE_EVENT_STATS
+#define ESP32AT_BLE_EVENT_STATS             0   /* 1: collect event pipeline statistics */
+#endif
+
+#ifndef ESP32AT_BLE_EVENT_STATS_BUCKETS
+#define ESP32AT_BLE_EVENT_STATS_BUCKETS     12  /* bucket n: latency < (64us << n), last: the rest */
+#endif
+
+#ifndef ESP32AT_BLE_DISPATCHER_PRIORITY
+#define ESP32AT_BLE_DISPATCHER_PRIORITY     osPriorityAboveNormal
+#endif
+
+#ifndef ESP32AT_BLE_DISPATCHER_STACK_SIZE
+#define ESP32AT_BLE_DISPATCHER_STACK_SIZE   2048
+#endif
 
 namespace ble {
 
@@ -80,27 +114,172 @@ public:
 
     virtual void signalEventsToProcess(BLE::InstanceID_t id);
 
+    /**
+     * Set how much work a single processEvents() call may do.
+     *
+     * @param max_events Maximum number of queued events dispatched per call,
+     * 0 for no limit.
+     * @param max_time_us Time budget per call in microseconds, 0 for no
+     * limit. At least one event is dispatched per call regardless of it.
+     */
+    void setDrainBudget(uint32_t max_events, uint32_t max_time_us);
+
+    /**
+     * Number of events dispatched by the last processEvents() call.
+     */
+    uint32_t getLastDrainCount(void) const {
+        return _drain_count;
+    }
+
+    /**
+     * Let the stack own its event processing.
+     *
+     * A dispatcher thread is started which sleeps until modem data or a
+     * queued event is signalled. Without an event queue the thread drains
+     * both itself, so every BLE callback runs at the given priority. With an
+     * event queue, the thread posts each drain pass to it instead and the
+     * callbacks run wherever that queue is dispatched.
+     *
+     * Once started, the application must no longer call waitForEvent() or
+     * processEvents(), and the onEventsToProcess callback is not invoked.
+     *
+     * The Gap and GattServer state is not locked. Without an event queue,
+     * BLE API calls are only allowed from BLE callbacks, which run on the
+     * dispatcher thread. Pass the event queue the application calls the BLE
+     * API from if other threads need it.
+     *
+     * @param queue Queue receiving the user callbacks, or NULL.
+     * @param priority Priority of the dispatcher thread.
+     * @param stack_size Stack size of the dispatcher thread in bytes.
+     * @return BLE_ERROR_INVALID_STATE if already started, BLE_ERROR_NO_MEM
+     * if the thread could not be created.
+     */
+    ble_error_t startDispatcher(
+        events::EventQueue * queue = NULL,
+        osPriority priority = ESP32AT_BLE_DISPATCHER_PRIORITY,
+        uint32_t stack_size = ESP32AT_BLE_DISPATCHER_STACK_SIZE
+    );
+
+    /**
+     * Stop the dispatcher thread and return to application driven
+     * processing.
+     */
+    void stopDispatcher(void);
+
+    /**
+     * Software timers of the stack. Expired timers are run from
+     * processEvents().
+     */
+    atcmd::Esp32AtTimerWheel &getTimerWheel() {
+        return _timer_wheel;
+    }
+
+    /**
+     * Called by the modem SIGIO handler; out-of-band data is only polled
+     * after it fired.
+     */
+    void signalModemData(void);
+
     /* event process */
     #define EVENT_TYPE_COMMON   0
     #define EVENT_TYPE_SERVER   1
     #define EVENT_TYPE_CLIENT   2
+    #define EVENT_TYPE_TIMER    3
+    #define EVENT_TYPE_NUM      4
+
+    /* event priority, lower value runs first. Connection, disconnection and
+     * scan callbacks are not queued: they run from ble_process_oob(), which
+     * processEvents() calls before draining any of these levels. */
+    #define EVENT_PRIO_HIGH     0   /* timers, queued GAP work */
+    #define EVENT_PRIO_NORMAL   1   /* GATT server */
+    #define EVENT_PRIO_LOW      2   /* bulk GATT client I/O */
+    #define EVENT_PRIO_NUM      3
 
-    struct EventQue {
+    typedef struct {
         uint32_t          type;
         uint32_t          id;
         void *            arg;
-        struct EventQue * p_next;
-    };
-    typedef struct EventQue EventQue_t;
+#if ESP32AT_BLE_EVENT_STATS
+        uint32_t          enqueue_us;
+#endif
+    } EventQue_t;
+
+    typedef struct {
+        uint32_t enqueued;
+        uint32_t dispatched;
+        uint32_t dropped;           /* rejected because the queue was full */
+        uint32_t latency_max_us;    /* setEvent() to doEvent() */
+        uint64_t latency_total_us;
+        uint32_t latency_hist[ESP32AT_BLE_EVENT_STATS_BUCKETS];
+        uint32_t handler_max_us;    /* time spent in doEvent() */
+        uint64_t handler_total_us;
+    } event_stats_t;
+
+    /**
+     * Event pipeline statistics of one event type.
+     *
+     * @param type EVENT_TYPE_xxx.
+     * @return BLE_ERROR_NOT_IMPLEMENTED if built without
+     * ESP32AT_BLE_EVENT_STATS, BLE_ERROR_INVALID_PARAM for an unknown type.
+     */
+    ble_error_t getEventStats(uint32_t type, event_stats_t * p_stats) const;
 
-    bool setEvent(uint32_t type, uint32_t id, void * arg);
+    /**
+     * Highest number of events queued at once, 0 if built without
+     * ESP32AT_BLE_EVENT_STATS.
+     */
+    uint32_t getEventQueueHighWater(void) const;
+
+    void resetEventStats(void);
+
+    /**
+     * Queue an event for processEvents().
+     *
+     * Events are queued per priority level and higher levels are served
+     * first. A pending lower level is served after it was passed over
+     * ESP32AT_BLE_EVENT_STARVATION_LIMIT times in a row.
+     *
+     * @param prio EVENT_PRIO_xxx; by default derived from the type.
+     * @return BLE_ERROR_NONE, or BLE_ERROR_BUFFER_OVERFLOW if all
+     * ESP32AT_BLE_EVENT_QUE_SIZE slots of the level are in use.
+     */
+    ble_error_t setEvent(uint32_t type, uint32_t id, void * arg);
+    ble_error_t setEvent(uint32_t type, uint32_t id, void * arg, uint32_t prio);
 
 private:
     bool              initialized;
     BLE::InstanceID_t instanceID;
     ESP32 *_esp;
-    EventFlags *      p_event_flg;
-    EventQue_t *      _event_que_top;
+    EventFlags        _event_flg;
+    atcmd::Esp32AtTimerWheel _timer_wheel;
+
+    Thread *             _dispatcher;
+    events::EventQueue * _dispatch_queue;
+    volatile bool        _dispatch_posted;
+
+    /* One ring buffer per priority level. _event_que_head is only advanced
+     * by the consumer (processEvents) and _event_que_tail only by the
+     * producer (setEvent); both run freely and are masked on access. */
+    EventQue_t        _event_que[EVENT_PRIO_NUM][ESP32AT_BLE_EVENT_QUE_SIZE];
+    volatile uint32_t _event_que_head[EVENT_PRIO_NUM];
+    volatile uint32_t _event_que_tail[EVENT_PRIO_NUM];
+    uint32_t          _event_que_skip[EVENT_PRIO_NUM];
+
+#if ESP32AT_BLE_EVENT_STATS
+    event_stats_t     _event_stats[EVENT_TYPE_NUM];
+    uint32_t          _event_que_high_water;
+#endif
+
+    volatile bool     _sigio_pending;
+    uint32_t          _drain_max_events;
+    uint32_t          _drain_max_time_us;
+    uint32_t          _drain_count;
+
+    bool getEvent(EventQue_t * p_event);
+    bool hasEvent(void) const;
+    void dispatcherMain(void);
+    void dispatchOnQueue(void);
+    bool timerTick(void);
 
 };
 
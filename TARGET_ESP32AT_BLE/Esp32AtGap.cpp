@@ -36,8 +36,21 @@ Esp32AtGap &Esp32AtGap::getInstance() {
     return m_instance;
 }
 
-Esp32AtGap::Esp32AtGap() : _scan(false), _connect(false) {
+Esp32AtGap::Esp32AtGap() : _scan(false), _scan_dedup_enabled(false), _scan_dedup_reset_ms(0),
+    _scan_batch_count(ESP32AT_BLE_SCAN_BATCH_SIZE), _scan_batch_time_ms(0),
+    _scan_table_enabled(false), _scan_table_sweep_ms(0),
+    _scan_duration_ms(0), _scan_period_ms(0), _whitelist_size(0), _scan_whitelist(false), _connect_whitelist(false), _connect_scan(false),
+    _conn_server(0), _services_started(false) {
     _esp = ESP32::getESP32Inst();
+    _shadow = &Esp32AtModemShadow::getInstance();
+    for (advertising_handle_t i = 0; i < ESP32AT_BLE_MAX_ADVERTISING_SETS; i++) {
+        initAdvertisingSet(i);
+    }
+    _adv_set[LEGACY_ADVERTISING_HANDLE].created = true;
+    _adv_on_air = ADV_SET_NONE;
+    memset(_conn, 0, sizeof(_conn));
+    _adv_update_interval_ms = ESP32AT_BLE_ADV_UPDATE_INTERVAL_MS;
+    _adv_last_update_ms = 0;
     _esp->ble_attach_sigio(callback(this, &Esp32AtGap::ble_sigio_cb));
     _esp->ble_attach_conn(callback(this, &Esp32AtGap::ble_conn_cb));
     _esp->ble_attach_disconn(callback(this, &Esp32AtGap::ble_disconn_cb));
@@ -81,9 +94,16 @@ ble_error_t Esp32AtGap::setScanParameters_(const ScanParameters &params)
         scan_type = 1;
     }
 
+    /* The modem has no command to fill its whitelist, the policy is
+     * applied to the reports here instead. */
+    int filter = (int)params.getFilter().value();
+
+    _scan_whitelist = ((filter & 0x01) != 0);
+    filter &= ~0x01;
+
     if (!_esp->ble_set_scan_param(scan_type,
             (int)params.getOwnAddressType().value(),
-            (int)params.getFilter().value(),
+            filter,
             (int)params.get1mPhyConfiguration().getInterval().value(),
             (int)params.get1mPhyConfiguration().getWindow().value())
     ) {
@@ -101,14 +121,39 @@ ble_error_t Esp32AtGap::startScan_(
 {
     useVersionTwoAPI();
 
+    /* With a period, scan for duration in every period until stopped. */
+    if ((period.valueInMs() > 0) && (duration.valueInMs() > 0)) {
+        if (duration.valueInMs() >= period.valueInMs()) {
+            return BLE_ERROR_INVALID_PARAM;
+        }
+        _scan_period_ms = period.valueInMs();
+    } else {
+        _scan_period_ms = 0;
+    }
+
+    /* The modem reports every advertisement, duplicates are dropped here. */
+    _scan_dedup.clear();
+    _scan_dedup.resetSuppressed();
+    _scan_dedup_enabled = (filtering != duplicates_filter_t::DISABLE);
+
     if (!_esp->ble_start_scan()) {
         return BLE_ERROR_INVALID_STATE;
     }
     _scan = true;
 
-    if (duration.valueInMs() > 0) {
-        timestamp_t timestamp = duration.valueInMs() * 1000;
-        scanTimeout.attach_us(callback(this, &Esp32AtGap::scanTimeoutCallback), timestamp);
+    if (filtering == duplicates_filter_t::PERIODIC_RESET) {
+        _scan_dedup_reset_ms = period.valueInMs();
+        if (_scan_dedup_reset_ms == 0) {
+            _scan_dedup_reset_ms = ESP32AT_BLE_SCAN_DEDUP_RESET_MS;
+        }
+        Esp32AtBLE::deviceInstance().getTimerWheel().start(
+            &_scan_dedup_timer, _scan_dedup_reset_ms, callback(this, &Esp32AtGap::scanDedupResetCallback));
+    }
+
+    _scan_duration_ms = duration.valueInMs();
+    if (_scan_duration_ms > 0) {
+        Esp32AtBLE::deviceInstance().getTimerWheel().start(
+            &scanTimeout, _scan_duration_ms, callback(this, &Esp32AtGap::scanTimeoutCallback));
     }
 
     return BLE_ERROR_NONE;
@@ -117,7 +162,15 @@ ble_error_t Esp32AtGap::startScan_(
 ble_error_t Esp32AtGap::stopScan_()
 {
     _scan = false;
-    scanTimeout.detach();
+    Esp32AtBLE::deviceInstance().getTimerWheel().stop(&scanTimeout);
+    Esp32AtBLE::deviceInstance().getTimerWheel().stop(&_scan_dedup_timer);
+    Esp32AtBLE::deviceInstance().getTimerWheel().stop(&_scan_period_timer);
+
+    /* A pending whitelist connection takes over the modem scan. */
+    if (_connect_whitelist) {
+        _connect_scan = true;
+        return BLE_ERROR_NONE;
+    }
     if (!_esp->ble_stop_scan()) {
         return BLE_ERROR_INVALID_STATE;
     }
@@ -142,19 +195,25 @@ ble_error_t Esp32AtGap::getAddress_(
         address[5] = randam_addr[0];
     } else {
         uint8_t tmp_buf[6];
+        const uint8_t * p_addr;
 
         if (typeP != NULL) {
             *typeP = BLEProtocol::AddressType::PUBLIC;
         }
-        if (!_esp->ble_get_addr(tmp_buf)) {
-            return BLE_ERROR_INVALID_STATE;
+        p_addr = _shadow->get(SHADOW_PUBLIC_ADDR);
+        if (p_addr == NULL) {
+            if (!_esp->ble_get_addr(tmp_buf)) {
+                return BLE_ERROR_INVALID_STATE;
+            }
+            _shadow->update(SHADOW_PUBLIC_ADDR, tmp_buf, sizeof(tmp_buf));
+            p_addr = tmp_buf;
         }
-        address[0] = tmp_buf[5];
-        address[1] = tmp_buf[4];
-        address[2] = tmp_buf[3];
-        address[3] = tmp_buf[2];
-        address[4] = tmp_buf[1];
-        address[5] = tmp_buf[0];
+        address[0] = p_addr[5];
+        address[1] = p_addr[4];
+        address[2] = p_addr[3];
+        address[3] = p_addr[2];
+        address[4] = p_addr[1];
+        address[5] = p_addr[0];
     }
 
     return BLE_ERROR_NONE;
@@ -162,9 +221,16 @@ ble_error_t Esp32AtGap::getAddress_(
 
 ble_error_t Esp32AtGap::setDeviceName_(const uint8_t *deviceName)
 {
+    uint32_t len = strlen((const char *)deviceName) + 1;
+
+    if (_shadow->matches(SHADOW_DEVICE_NAME, deviceName, len)) {
+        return BLE_ERROR_NONE;
+    }
     if (!_esp->ble_set_device_name((char *)deviceName)) {
+        _shadow->invalidate(SHADOW_DEVICE_NAME);
         return BLE_ERROR_PARAM_OUT_OF_RANGE;
     }
+    _shadow->update(SHADOW_DEVICE_NAME, deviceName, len);
     return BLE_ERROR_NONE;
 }
 
@@ -174,22 +240,24 @@ ble_error_t Esp32AtGap::getDeviceName_(uint8_t *deviceName, unsigned *lengthP)
         return BLE_ERROR_INVALID_PARAM;
     }
 
-    char * wk_name = new char[128];
+    char wk_name[128];
+    const char * p_name = (const char *)_shadow->get(SHADOW_DEVICE_NAME);
 
-    if (!_esp->ble_get_device_name(wk_name)) {
-        delete [] wk_name;
-        return BLE_ERROR_PARAM_OUT_OF_RANGE;
+    if (p_name == NULL) {
+        if (!_esp->ble_get_device_name(wk_name)) {
+            return BLE_ERROR_PARAM_OUT_OF_RANGE;
+        }
+        _shadow->update(SHADOW_DEVICE_NAME, wk_name, strlen(wk_name) + 1);
+        p_name = wk_name;
     }
 
-    unsigned len = strlen(wk_name);
+    unsigned len = strlen(p_name);
 
     if (len > *lengthP) {
-        delete [] wk_name;
         return BLE_ERROR_PARAM_OUT_OF_RANGE;
     }
     *lengthP = len;
-    memcpy(deviceName, wk_name, len);
-    delete [] wk_name;
+    memcpy(deviceName, p_name, len);
 
     return BLE_ERROR_NONE;
 }
@@ -199,87 +267,91 @@ ble_error_t Esp32AtGap::setAdvertisingParameters_(
     const AdvertisingParameters &params
 )
 {
-    advertising_param.adv_int_min = params.getMinPrimaryInterval().value();
-    if ((advertising_param.adv_int_min < getMinAdvertisingInterval_())
-     || (advertising_param.adv_int_min > getMaxAdvertisingInterval_())) {
+    if ((handle >= ESP32AT_BLE_MAX_ADVERTISING_SETS) || !_adv_set[handle].created) {
+        return BLE_ERROR_INVALID_PARAM;
+    }
+
+    /* Kept per set; the shared copy follows the set on air. */
+    ESP32::advertising_param_t param = _adv_set[handle].configured ? _adv_set[handle].param : advertising_param;
+
+    param.adv_int_min = params.getMinPrimaryInterval().value();
+    if ((param.adv_int_min < getMinAdvertisingInterval_())
+     || (param.adv_int_min > getMaxAdvertisingInterval_())) {
         return BLE_ERROR_INVALID_PARAM;
     }
 
-    advertising_param.adv_int_max = params.getMaxPrimaryInterval().value();
-    if ((advertising_param.adv_int_max < getMinAdvertisingInterval_())
-     || (advertising_param.adv_int_max > getMaxAdvertisingInterval_())) {
+    param.adv_int_max = params.getMaxPrimaryInterval().value();
+    if ((param.adv_int_max < getMinAdvertisingInterval_())
+     || (param.adv_int_max > getMaxAdvertisingInterval_())) {
         return BLE_ERROR_INVALID_PARAM;
     }
 
-    if (advertising_param.adv_int_min > advertising_param.adv_int_max) {
+    if (param.adv_int_min > param.adv_int_max) {
         return BLE_ERROR_INVALID_PARAM;
     }
 
     if (params.getType() == advertising_type_t::CONNECTABLE_UNDIRECTED) {
-        advertising_param.adv_type = ADV_TYPE_IND;
+        param.adv_type = ADV_TYPE_IND;
     } else if (params.getType() == advertising_type_t::SCANNABLE_UNDIRECTED) {
-        advertising_param.adv_type = ADV_TYPE_SCAN_IND;
+        param.adv_type = ADV_TYPE_SCAN_IND;
     } else if (params.getType() == advertising_type_t::NON_CONNECTABLE_UNDIRECTED) {
-        advertising_param.adv_type = ADV_TYPE_NONCONN_IND;
+        param.adv_type = ADV_TYPE_NONCONN_IND;
     } else {
         return BLE_ERROR_INVALID_PARAM;
     }
 
     if (params.getOwnAddressType() == own_address_type_t::PUBLIC) {
-        advertising_param.own_addr_type = BLE_ADDR_TYPE_PUBLIC;
-        _esp->ble_set_addr(0);
+        param.own_addr_type = BLE_ADDR_TYPE_PUBLIC;
     } else if (params.getOwnAddressType() == own_address_type_t::RANDOM) {
-        advertising_param.own_addr_type = BLE_ADDR_TYPE_RANDOM;
-        set_randam_addr();
-        _esp->ble_set_addr(1, randam_addr);
+        param.own_addr_type = BLE_ADDR_TYPE_RANDOM;
     } else {
         return BLE_ERROR_INVALID_PARAM;
     }
 
-    advertising_param.channel_map = 0;
+    param.channel_map = 0;
     if (params.getChannel37()) {
-        advertising_param.channel_map = ADV_CHNL_37;
+        param.channel_map = ADV_CHNL_37;
     }
     if (params.getChannel38()) {
-        advertising_param.channel_map = ADV_CHNL_38;
+        param.channel_map = ADV_CHNL_38;
     }
     if (params.getChannel39()) {
-        advertising_param.channel_map = ADV_CHNL_39;
+        param.channel_map = ADV_CHNL_39;
     }
 
+    /* The whitelist is kept on the host and the modem's stays empty, so a
+     * filtering policy would refuse every peer. */
     if (params.getFilter() == advertising_filter_policy_t::NO_FILTER) {
-        advertising_param.adv_filter_policy = ADV_FILTER_ALLOW_SCAN_ANY_CON_ANY;
-    } else if (params.getFilter() == advertising_filter_policy_t::FILTER_SCAN_REQUESTS) {
-        advertising_param.adv_filter_policy = ADV_FILTER_ALLOW_SCAN_WLST_CON_ANY;
-    } else if (params.getFilter() == advertising_filter_policy_t::FILTER_CONNECTION_REQUEST) {
-        advertising_param.adv_filter_policy = ADV_FILTER_ALLOW_SCAN_ANY_CON_WLST;
-    } else if (params.getFilter() == advertising_filter_policy_t::FILTER_SCAN_AND_CONNECTION_REQUESTS) {
-        advertising_param.adv_filter_policy = ADV_FILTER_ALLOW_SCAN_WLST_CON_WLST;
+        param.adv_filter_policy = ADV_FILTER_ALLOW_SCAN_ANY_CON_ANY;
+    } else if ((params.getFilter() == advertising_filter_policy_t::FILTER_SCAN_REQUESTS)
+            || (params.getFilter() == advertising_filter_policy_t::FILTER_CONNECTION_REQUEST)
+            || (params.getFilter() == advertising_filter_policy_t::FILTER_SCAN_AND_CONNECTION_REQUESTS)) {
+        return BLE_ERROR_NOT_IMPLEMENTED;
     } else {
         return BLE_ERROR_INVALID_PARAM;
     }
 
     if (params.getPeerAddressType() == target_peer_address_type_t::PUBLIC) {
-        advertising_param.peer_addr_type = BLE_ADDR_TYPE_PUBLIC;
+        param.peer_addr_type = BLE_ADDR_TYPE_PUBLIC;
     } else if (params.getPeerAddressType() == target_peer_address_type_t::RANDOM) {
-        advertising_param.peer_addr_type = BLE_ADDR_TYPE_RANDOM;
+        param.peer_addr_type = BLE_ADDR_TYPE_RANDOM;
     } else {
         return BLE_ERROR_INVALID_PARAM;
     }
 
-    advertising_param.peer_addr[5] = params.getPeerAddress()[0];
-    advertising_param.peer_addr[4] = params.getPeerAddress()[1];
-    advertising_param.peer_addr[3] = params.getPeerAddress()[2];
-    advertising_param.peer_addr[2] = params.getPeerAddress()[3];
-    advertising_param.peer_addr[1] = params.getPeerAddress()[4];
-    advertising_param.peer_addr[0] = params.getPeerAddress()[5];
+    param.peer_addr[5] = params.getPeerAddress()[0];
+    param.peer_addr[4] = params.getPeerAddress()[1];
+    param.peer_addr[3] = params.getPeerAddress()[2];
+    param.peer_addr[2] = params.getPeerAddress()[3];
+    param.peer_addr[1] = params.getPeerAddress()[4];
+    param.peer_addr[0] = params.getPeerAddress()[5];
 
-    if (!_esp->ble_set_advertising_param(&advertising_param)) {
-        return BLE_ERROR_INVALID_STATE;
-    }
+    _adv_set[handle].param      = param;
+    _adv_set[handle].configured = true;
 
-    if (!_esp->ble_start_services()) {
-        return BLE_ERROR_INVALID_STATE;
+    /* Another set on air picks this up at its next switch. */
+    if ((_adv_on_air == ADV_SET_NONE) || (_adv_on_air == handle)) {
+        return applyAdvertisingParams(&_adv_set[handle].param);
     }
 
     return BLE_ERROR_NONE;
@@ -290,38 +362,52 @@ ble_error_t Esp32AtGap::setAdvertisingPayload_(
     mbed::Span<const uint8_t> payload
 )
 {
-    char * p_buf = (char *)payload.data();
-    uint8_t field_size;
-    uint8_t field_type;
-    uint8_t name_field_type = 0;
-    int idx = 0;
-    int payload_size = payload.size();
-    char * dev_name_buf = NULL;
-
-    while (idx < payload_size) {
-        field_size = p_buf[idx];
-        field_type = p_buf[idx + 1];
-        if ((field_type == adv_data_type_t::SHORTENED_LOCAL_NAME)
-         || (field_type == adv_data_type_t::COMPLETE_LOCAL_NAME)) {
-            if ((name_field_type == adv_data_type_t::SHORTENED_LOCAL_NAME) && (dev_name_buf != NULL)) {
-                delete[] dev_name_buf;
-                dev_name_buf = NULL;
-            }
-            if (dev_name_buf == NULL) {
-                dev_name_buf = new char[field_size];
-                memcpy(dev_name_buf, &p_buf[idx + 2], field_size - 1);
-                dev_name_buf[field_size - 1] = 0;
-                name_field_type = field_type;
-            }
+    if ((handle >= ESP32AT_BLE_MAX_ADVERTISING_SETS) || !_adv_set[handle].created) {
+        return BLE_ERROR_INVALID_PARAM;
+    }
+    if (payload.size() > ESP32AT_BLE_SHADOW_ADV_DATA_SIZE) {
+        return BLE_ERROR_INVALID_PARAM;
+    }
+
+    Esp32AtAdParser parser(payload);
+    Esp32AtAdParser::ad_field_t field;
+    Esp32AtAdParser::ad_field_t name_field;
+    bool name_found = false;
+
+    while (parser.next(&field)) {
+        if (field.type == adv_data_type_t::COMPLETE_LOCAL_NAME) {
+            name_field = field;
+            name_found = true;
+            break;
+        }
+        if ((field.type == adv_data_type_t::SHORTENED_LOCAL_NAME) && !name_found) {
+            name_field = field;
+            name_found = true;
         }
-        idx += field_size + 1;
     }
-    if (dev_name_buf != NULL) {
-        _esp->ble_set_device_name(dev_name_buf);
-        delete[] dev_name_buf;
+    if (parser.isMalformed()) {
+        return BLE_ERROR_INVALID_PARAM;
     }
-    if (!_esp->ble_set_advertising_data(payload.data(), payload.size())) {
-        return BLE_ERROR_INVALID_STATE;
+
+    /* The device name is modem wide, it follows the set on air. */
+    if (name_found) {
+        if (name_field.value.size() >= (ptrdiff_t)sizeof(_adv_set[handle].name)) {
+            return BLE_ERROR_INVALID_PARAM;
+        }
+        memcpy(_adv_set[handle].name, name_field.value.data(), name_field.value.size());
+        _adv_set[handle].name[name_field.value.size()] = 0;
+    } else {
+        _adv_set[handle].name[0] = 0;
+    }
+
+    memcpy(_adv_set[handle].adv_data, payload.data(), payload.size());
+    _adv_set[handle].adv_data_len = payload.size();
+
+    if ((_adv_on_air == ADV_SET_NONE) || (_adv_on_air == handle)) {
+        if (_adv_set[handle].name[0] != 0) {
+            setDeviceName_((const uint8_t *)_adv_set[handle].name);
+        }
+        return applyAdvertisingData(SHADOW_ADV_DATA, payload.data(), payload.size());
     }
 
     return BLE_ERROR_NONE;
@@ -332,8 +418,18 @@ ble_error_t Esp32AtGap::setAdvertisingScanResponse_(
     mbed::Span<const uint8_t> response
 )
 {
-    if (!_esp->ble_set_scan_response(response.data(), response.size())) {
-        return BLE_ERROR_INVALID_STATE;
+    if ((handle >= ESP32AT_BLE_MAX_ADVERTISING_SETS) || !_adv_set[handle].created) {
+        return BLE_ERROR_INVALID_PARAM;
+    }
+    if (response.size() > ESP32AT_BLE_SHADOW_ADV_DATA_SIZE) {
+        return BLE_ERROR_INVALID_PARAM;
+    }
+
+    memcpy(_adv_set[handle].scan_response, response.data(), response.size());
+    _adv_set[handle].scan_response_len = response.size();
+
+    if ((_adv_on_air == ADV_SET_NONE) || (_adv_on_air == handle)) {
+        return applyAdvertisingData(SHADOW_SCAN_RESPONSE, response.data(), response.size());
     }
 
     return BLE_ERROR_NONE;
@@ -345,30 +441,445 @@ ble_error_t Esp32AtGap::startAdvertising_(
     uint8_t maxEvents
 )
 {
-    advertising_handle = handle;
-    _esp->ble_start_advertising();
+    adv_set_t * p_set;
+
+    if ((handle >= ESP32AT_BLE_MAX_ADVERTISING_SETS) || !_adv_set[handle].created) {
+        return BLE_ERROR_INVALID_PARAM;
+    }
+    p_set = &_adv_set[handle];
 
+    p_set->active     = true;
+    p_set->max_events = maxEvents;
+    p_set->events     = 0;
+    p_set->on_air_ms  = Kernel::get_ms_count();
     if (maxDuration.valueInMs() > 0) {
-        timestamp_t timestamp = maxDuration.valueInMs() * 1000;
-        advertisingTimeout.attach_us(callback(this, &Esp32AtGap::advertisingTimeoutCallback), timestamp);
+        p_set->end_ms = Kernel::get_ms_count() + maxDuration.valueInMs();
+        Esp32AtBLE::deviceInstance().getTimerWheel().start(
+            &p_set->timeout, maxDuration.valueInMs(), callback(this, &Esp32AtGap::advertisingTimeoutCallback));
+    } else {
+        p_set->end_ms = 0;
+        Esp32AtBLE::deviceInstance().getTimerWheel().stop(&p_set->timeout);
+    }
+
+    if (_adv_on_air == ADV_SET_NONE) {
+        ble_error_t err = switchAdvertisingSet(handle);
+
+        if (err != BLE_ERROR_NONE) {
+            p_set->active = false;
+            Esp32AtBLE::deviceInstance().getTimerWheel().stop(&p_set->timeout);
+            return err;
+        }
+    } else if (_adv_on_air == handle) {
+        scheduleAdvertisingEvents();
+    }
+    scheduleAdvertisingRotation();
+
+    return BLE_ERROR_NONE;
+}
+
+ble_error_t Esp32AtGap::stopAdvertising_(advertising_handle_t handle)
+{
+    if ((handle >= ESP32AT_BLE_MAX_ADVERTISING_SETS) || !_adv_set[handle].created) {
+        return BLE_ERROR_INVALID_PARAM;
+    }
+
+    endAdvertisingSet(handle);
+
+    return BLE_ERROR_NONE;
+}
+
+bool Esp32AtGap::isAdvertisingActive_(advertising_handle_t handle)
+{
+    if (handle >= ESP32AT_BLE_MAX_ADVERTISING_SETS) {
+        return false;
+    }
+    return _adv_set[handle].active;
+}
+
+uint8_t Esp32AtGap::getMaxAdvertisingSetNumber_()
+{
+    return ESP32AT_BLE_MAX_ADVERTISING_SETS;
+}
+
+ble_error_t Esp32AtGap::createAdvertisingSet_(
+    advertising_handle_t *handle,
+    const AdvertisingParameters &parameters
+)
+{
+    if (handle == NULL) {
+        return BLE_ERROR_INVALID_PARAM;
+    }
+
+    for (advertising_handle_t i = 1; i < ESP32AT_BLE_MAX_ADVERTISING_SETS; i++) {
+        if (!_adv_set[i].created) {
+            _adv_set[i].created = true;
+            ble_error_t err = setAdvertisingParameters_(i, parameters);
+            if (err != BLE_ERROR_NONE) {
+                _adv_set[i].created = false;
+                return err;
+            }
+            *handle = i;
+            return BLE_ERROR_NONE;
+        }
+    }
+
+    return BLE_ERROR_NO_MEM;
+}
+
+ble_error_t Esp32AtGap::destroyAdvertisingSet_(advertising_handle_t handle)
+{
+    if ((handle == LEGACY_ADVERTISING_HANDLE) || (handle >= ESP32AT_BLE_MAX_ADVERTISING_SETS)
+     || !_adv_set[handle].created) {
+        return BLE_ERROR_INVALID_PARAM;
+    }
+    if (_adv_set[handle].active) {
+        return BLE_ERROR_INVALID_STATE;
+    }
+
+    initAdvertisingSet(handle);
+
+    return BLE_ERROR_NONE;
+}
+
+ble_error_t Esp32AtGap::setAdvertisingSlot(advertising_handle_t handle, uint32_t slot_ms)
+{
+    if ((handle >= ESP32AT_BLE_MAX_ADVERTISING_SETS) || !_adv_set[handle].created || (slot_ms == 0)) {
+        return BLE_ERROR_INVALID_PARAM;
+    }
+    _adv_set[handle].slot_ms = slot_ms;
+
+    return BLE_ERROR_NONE;
+}
+
+ble_error_t Esp32AtGap::updateAdvertisingPayload(
+    advertising_handle_t handle,
+    uint32_t offset,
+    mbed::Span<const uint8_t> data,
+    bool scan_response
+)
+{
+    adv_set_t * p_set;
+    uint8_t * p_buf;
+    uint32_t len;
+
+    if ((handle >= ESP32AT_BLE_MAX_ADVERTISING_SETS) || !_adv_set[handle].created) {
+        return BLE_ERROR_INVALID_PARAM;
+    }
+    p_set = &_adv_set[handle];
+
+    if (scan_response) {
+        p_buf = p_set->scan_response;
+        len   = p_set->scan_response_len;
+    } else {
+        p_buf = p_set->adv_data;
+        len   = p_set->adv_data_len;
+    }
+    if ((offset > len) || ((uint32_t)data.size() > (len - offset))) {
+        return BLE_ERROR_INVALID_PARAM;
+    }
+
+    memcpy(&p_buf[offset], data.data(), data.size());
+    p_set->dirty |= scan_response ? ADV_DIRTY_SCAN_RESPONSE : ADV_DIRTY_DATA;
+
+    /* A set off air gets its buffers at the next switch. */
+    if (_adv_on_air != handle) {
+        return BLE_ERROR_NONE;
+    }
+
+    uint64_t elapsed_ms = Kernel::get_ms_count() - _adv_last_update_ms;
+
+    if (elapsed_ms >= _adv_update_interval_ms) {
+        advertisingUpdateCallback();
+    } else if (!_adv_update_timer.active) {
+        Esp32AtBLE::deviceInstance().getTimerWheel().start(
+            &_adv_update_timer, (uint32_t)(_adv_update_interval_ms - elapsed_ms),
+            callback(this, &Esp32AtGap::advertisingUpdateCallback));
+    }
+
+    return BLE_ERROR_NONE;
+}
+
+void Esp32AtGap::advertisingUpdateCallback()
+{
+    adv_set_t * p_set;
+
+    if (_adv_on_air == ADV_SET_NONE) {
+        return;
+    }
+    p_set = &_adv_set[_adv_on_air];
+
+    if (p_set->dirty & ADV_DIRTY_DATA) {
+        applyAdvertisingData(SHADOW_ADV_DATA, p_set->adv_data, p_set->adv_data_len);
+    }
+    if (p_set->dirty & ADV_DIRTY_SCAN_RESPONSE) {
+        applyAdvertisingData(SHADOW_SCAN_RESPONSE, p_set->scan_response, p_set->scan_response_len);
+    }
+    p_set->dirty = 0;
+    _adv_last_update_ms = Kernel::get_ms_count();
+}
+
+ble_error_t Esp32AtGap::applyAdvertisingParams(const ESP32::advertising_param_t * p_param)
+{
+    uint8_t own_addr[7] = {0};
+
+    if (p_param->own_addr_type == BLE_ADDR_TYPE_RANDOM) {
+        set_randam_addr();
+        own_addr[0] = 1;
+        memcpy(&own_addr[1], randam_addr, sizeof(randam_addr));
+    }
+    if (!_shadow->matches(SHADOW_OWN_ADDR, own_addr, sizeof(own_addr))) {
+        bool result;
+
+        if (own_addr[0] == 1) {
+            result = _esp->ble_set_addr(1, randam_addr);
+        } else {
+            result = _esp->ble_set_addr(0);
+        }
+        if (result) {
+            _shadow->update(SHADOW_OWN_ADDR, own_addr, sizeof(own_addr));
+        } else {
+            _shadow->invalidate(SHADOW_OWN_ADDR);
+        }
+    }
+
+    if (!_shadow->matches(SHADOW_ADV_PARAM, p_param, sizeof(*p_param))) {
+        if (!_esp->ble_set_advertising_param(const_cast<ESP32::advertising_param_t *>(p_param))) {
+            _shadow->invalidate(SHADOW_ADV_PARAM);
+            return BLE_ERROR_INVALID_STATE;
+        }
+        _shadow->update(SHADOW_ADV_PARAM, p_param, sizeof(*p_param));
+    }
+    advertising_param = *p_param;
+
+    /* Starting the services is only needed once per GATT table. */
+    if (!_services_started) {
+        if (!_esp->ble_start_services()) {
+            return BLE_ERROR_INVALID_STATE;
+        }
+        _services_started = true;
+    }
+
+    return BLE_ERROR_NONE;
+}
+
+ble_error_t Esp32AtGap::applyAdvertisingData(uint32_t entry, const uint8_t * data, uint32_t len)
+{
+    bool result;
+
+    if (_shadow->matches(entry, data, len)) {
+        return BLE_ERROR_NONE;
+    }
+    if (entry == SHADOW_SCAN_RESPONSE) {
+        result = _esp->ble_set_scan_response(data, len);
+    } else {
+        result = _esp->ble_set_advertising_data(data, len);
+    }
+    if (!result) {
+        _shadow->invalidate(entry);
+        return BLE_ERROR_INVALID_STATE;
+    }
+    _shadow->update(entry, data, len);
+
+    return BLE_ERROR_NONE;
+}
+
+ble_error_t Esp32AtGap::switchAdvertisingSet(advertising_handle_t handle)
+{
+    adv_set_t * p_set = &_adv_set[handle];
+    ble_error_t err;
+
+    if (_adv_on_air != ADV_SET_NONE) {
+        _esp->ble_stop_advertising();
+        takeAdvertisingOffAir();
+    }
+
+    /* The shadow drops whatever the modem already holds, so switching
+     * between sets only sends what differs. */
+    if (p_set->configured) {
+        err = applyAdvertisingParams(&p_set->param);
+        if (err != BLE_ERROR_NONE) {
+            return err;
+        }
+    }
+    if (p_set->name[0] != 0) {
+        setDeviceName_((const uint8_t *)p_set->name);
+    }
+    /* A payload the set never configured is not sent. */
+    if (p_set->adv_data_len != 0) {
+        err = applyAdvertisingData(SHADOW_ADV_DATA, p_set->adv_data, p_set->adv_data_len);
+        if (err != BLE_ERROR_NONE) {
+            return err;
+        }
+    }
+    if (p_set->scan_response_len != 0) {
+        err = applyAdvertisingData(SHADOW_SCAN_RESPONSE, p_set->scan_response, p_set->scan_response_len);
+        if (err != BLE_ERROR_NONE) {
+            return err;
+        }
+    }
+    p_set->dirty = 0;
+
+    if (!_esp->ble_start_advertising()) {
+        return BLE_ERROR_INVALID_STATE;
     }
+    _adv_on_air = handle;
+    p_set->on_air_ms = Kernel::get_ms_count();
+    scheduleAdvertisingEvents();
 
     return BLE_ERROR_NONE;
 }
 
+void Esp32AtGap::endAdvertisingSet(advertising_handle_t handle)
+{
+    _adv_set[handle].active = false;
+    Esp32AtBLE::deviceInstance().getTimerWheel().stop(&_adv_set[handle].timeout);
+
+    if (_adv_on_air == handle) {
+        _esp->ble_stop_advertising();
+        takeAdvertisingOffAir();
+        resumeAdvertising(handle);
+    }
+    scheduleAdvertisingRotation();
+}
+
+void Esp32AtGap::resumeAdvertising(advertising_handle_t after)
+{
+    for (uint32_t i = 1; i <= ESP32AT_BLE_MAX_ADVERTISING_SETS; i++) {
+        advertising_handle_t next = (after + i) % ESP32AT_BLE_MAX_ADVERTISING_SETS;
+
+        if (_adv_set[next].active) {
+            if ((next == _adv_on_air) || (switchAdvertisingSet(next) == BLE_ERROR_NONE)) {
+                return;
+            }
+        }
+    }
+}
+
+void Esp32AtGap::scheduleAdvertisingRotation()
+{
+    uint32_t active = 0;
+
+    for (uint32_t i = 0; i < ESP32AT_BLE_MAX_ADVERTISING_SETS; i++) {
+        if (_adv_set[i].active) {
+            active++;
+        }
+    }
+
+    if ((active < 2) || (_adv_on_air == ADV_SET_NONE)) {
+        Esp32AtBLE::deviceInstance().getTimerWheel().stop(&_adv_rotation_timer);
+    } else if (!_adv_rotation_timer.active) {
+        Esp32AtBLE::deviceInstance().getTimerWheel().start(
+            &_adv_rotation_timer, _adv_set[_adv_on_air].slot_ms,
+            callback(this, &Esp32AtGap::advertisingRotationCallback));
+    }
+}
+
+void Esp32AtGap::advertisingRotationCallback()
+{
+    if (_adv_on_air != ADV_SET_NONE) {
+        resumeAdvertising(_adv_on_air);
+    }
+    scheduleAdvertisingRotation();
+}
+
+void Esp32AtGap::takeAdvertisingOffAir()
+{
+    if (_adv_on_air != ADV_SET_NONE) {
+        _adv_set[_adv_on_air].events = advertisingEvents(_adv_on_air);
+        _adv_on_air = ADV_SET_NONE;
+    }
+    Esp32AtBLE::deviceInstance().getTimerWheel().stop(&_adv_events_timer);
+}
+
+void Esp32AtGap::scheduleAdvertisingEvents()
+{
+    adv_set_t * p_set;
+    uint8_t events;
+
+    Esp32AtBLE::deviceInstance().getTimerWheel().stop(&_adv_events_timer);
+    if (_adv_on_air == ADV_SET_NONE) {
+        return;
+    }
+    p_set = &_adv_set[_adv_on_air];
+    if (p_set->max_events == 0) {
+        return;
+    }
+
+    /* The first event goes out as soon as advertising starts, the
+     * remaining ones one interval apart. */
+    events = advertisingEvents(_adv_on_air);
+    if (events >= p_set->max_events) {
+        advertisingEventsCallback();
+        return;
+    }
+    Esp32AtBLE::deviceInstance().getTimerWheel().start(
+        &_adv_events_timer, (p_set->max_events - events) * advertisingEventMs(p_set),
+        callback(this, &Esp32AtGap::advertisingEventsCallback));
+}
+
+uint32_t Esp32AtGap::advertisingEventMs(const adv_set_t * p_set) const
+{
+    const ESP32::advertising_param_t * p_param = p_set->configured ? &p_set->param : &advertising_param;
+
+    /* The firmware does not count events. The controller picks an interval
+     * in [min, max] (0.625 ms units) and adds a 0-10 ms random delay. */
+    return (((uint32_t)p_param->adv_int_min + (uint32_t)p_param->adv_int_max) * 5 / 16) + 5;
+}
+
+uint8_t Esp32AtGap::advertisingEvents(advertising_handle_t handle) const
+{
+    const adv_set_t * p_set = &_adv_set[handle];
+    uint32_t events = p_set->events;
+
+    if (_adv_on_air == handle) {
+        events += (uint32_t)((Kernel::get_ms_count() - p_set->on_air_ms) / advertisingEventMs(p_set)) + 1;
+    }
+    if (events > 0xFF) {
+        events = 0xFF;
+    }
+
+    return (uint8_t)events;
+}
+
+void Esp32AtGap::initAdvertisingSet(advertising_handle_t handle)
+{
+    adv_set_t * p_set = &_adv_set[handle];
+
+    p_set->created           = false;
+    p_set->configured        = false;
+    p_set->active            = false;
+    p_set->adv_data_len      = 0;
+    p_set->scan_response_len = 0;
+    p_set->name[0]           = 0;
+    p_set->slot_ms           = ESP32AT_BLE_ADV_SLOT_MS;
+    p_set->dirty             = 0;
+    p_set->end_ms            = 0;
+    p_set->max_events        = 0;
+    p_set->events            = 0;
+}
+
 void Esp32AtGap::ble_sigio_cb(void)
 {
-    Esp32AtBLE::deviceInstance().signalEventsToProcess(::BLE::DEFAULT_INSTANCE);
+    Esp32AtBLE::deviceInstance().signalModemData();
 }
 
 void Esp32AtGap::ble_conn_cb(int conn_index, uint8_t * remote_addr)
 {
-    int role;
+    int role = INIT_SERVER_ROLE;
+    const uint8_t * p_role;
     ble::address_t peerAddress;
+    conn_entry_t * p_conn;
 
-    _connect = true;
+    if ((conn_index < 0) || (conn_index >= ESP32AT_BLE_MAX_CONNECTIONS)) {
+        return;
+    }
 
-    _esp->ble_get_role(&role);
+    p_role = _shadow->get(SHADOW_ROLE);
+    if (p_role != NULL) {
+        memcpy(&role, p_role, sizeof(role));
+    } else if (_esp->ble_get_role(&role)) {
+        _shadow->update(SHADOW_ROLE, &role, sizeof(role));
+    }
     peerAddress[5] = remote_addr[0];
     peerAddress[4] = remote_addr[1];
     peerAddress[3] = remote_addr[2];
@@ -376,6 +887,22 @@ void Esp32AtGap::ble_conn_cb(int conn_index, uint8_t * remote_addr)
     peerAddress[1] = remote_addr[4];
     peerAddress[0] = remote_addr[5];
 
+    /* A connection ends the set the modem was advertising. */
+    if ((role != INIT_CLIENT_ROLE) && (_adv_on_air != ADV_SET_NONE)) {
+        advertising_handle_t handle = _adv_on_air;
+
+        _adv_set[handle].active = false;
+        Esp32AtBLE::deviceInstance().getTimerWheel().stop(&_adv_set[handle].timeout);
+        takeAdvertisingOffAir();
+        /* The other active sets keep advertising. */
+        resumeAdvertising(handle);
+        scheduleAdvertisingRotation();
+        if (_eventHandler) {
+            _eventHandler->onAdvertisingEnd(
+                AdvertisingEndEvent(handle, (connection_handle_t)conn_index, advertisingEvents(handle), true));
+        }
+    }
+
     // ConnectionCompleteEvent
     connection_role_t::type connection_role;
 
@@ -383,7 +910,21 @@ void Esp32AtGap::ble_conn_cb(int conn_index, uint8_t * remote_addr)
         connection_role = connection_role_t::CENTRAL;
     } else {
         connection_role = connection_role_t::PERIPHERAL;
+        _conn_server = (connection_handle_t)conn_index;
+    }
+
+    p_conn = &_conn[conn_index];
+    /* The modem gave the index of our pending connect() to a link we did
+     * not initiate, so that attempt can no longer complete. */
+    if (p_conn->pending && (connection_role != connection_role_t::CENTRAL)) {
+        p_conn->pending = false;
+        connectionFailed(BLE_ERROR_INVALID_STATE, p_conn->peer);
     }
+    p_conn->used     = true;
+    p_conn->pending  = false;
+    p_conn->role     = connection_role;
+    p_conn->peer     = peerAddress;
+    p_conn->att_mtu  = ESP32AT_BLE_DEFAULT_ATT_MTU;
 
     if (_eventHandler) {
         _eventHandler->onConnectionComplete(
@@ -395,6 +936,7 @@ void Esp32AtGap::ble_conn_cb(int conn_index, uint8_t * remote_addr)
                 peerAddress,
                 ble::address_t(),
                 ble::address_t(),
+                /* the AT commands do not report the connection parameters */
                 conn_interval_t::max(),
                 /* dummy slave latency */ 0,
                 supervision_timeout_t::max(),
@@ -429,11 +971,23 @@ void Esp32AtGap::ble_conn_cb(int conn_index, uint8_t * remote_addr)
 
 void Esp32AtGap::ble_disconn_cb(int conn_index)
 {
-    _connect = false;
+    if ((conn_index < 0) || (conn_index >= ESP32AT_BLE_MAX_CONNECTIONS)) {
+        return;
+    }
+    memset(&_conn[conn_index], 0, sizeof(_conn[conn_index]));
+    if (_conn_server == (connection_handle_t)conn_index) {
+        for (int i = 0; i < ESP32AT_BLE_MAX_CONNECTIONS; i++) {
+            if (_conn[i].used && (_conn[i].role == connection_role_t::PERIPHERAL)) {
+                _conn_server = (connection_handle_t)i;
+                break;
+            }
+        }
+    }
+
     if (_eventHandler) {
         _eventHandler->onDisconnectionComplete(
             DisconnectionCompleteEvent(
-                0,
+                (connection_handle_t)conn_index,
                 (disconnection_reason_t::type)REMOTE_USER_TERMINATED_CONNECTION
             )
         );
@@ -441,27 +995,67 @@ void Esp32AtGap::ble_disconn_cb(int conn_index)
 
     // legacy process event
     processDisconnectionEvent(
-        0,
+        (connection_handle_t)conn_index,
         (LegacyGap::DisconnectionReason_t)REMOTE_USER_TERMINATED_CONNECTION
     );
 }
 
 void Esp32AtGap::ble_scan_cb(ESP32::ble_scan_t * ble_scan)
 {
-    if (!_scan) {
+    uint8_t tmp_buf[6];
+
+    if (!_scan && !_connect_whitelist) {
         return;
     }
 
-    if (_eventHandler) {
-        uint8_t tmp_buf[6];
+    tmp_buf[5] = ble_scan->addr[0];
+    tmp_buf[4] = ble_scan->addr[1];
+    tmp_buf[3] = ble_scan->addr[2];
+    tmp_buf[2] = ble_scan->addr[3];
+    tmp_buf[1] = ble_scan->addr[4];
+    tmp_buf[0] = ble_scan->addr[5];
 
-        tmp_buf[5] = ble_scan->addr[0];
-        tmp_buf[4] = ble_scan->addr[1];
-        tmp_buf[3] = ble_scan->addr[2];
-        tmp_buf[2] = ble_scan->addr[3];
-        tmp_buf[1] = ble_scan->addr[4];
-        tmp_buf[0] = ble_scan->addr[5];
+    if (_connect_whitelist && whitelistContains(ble_scan->addr_type, tmp_buf)) {
+        whitelistConnect(ble_scan->addr);
+    }
+    if (!_scan || (_scan_whitelist && !whitelistContains(ble_scan->addr_type, tmp_buf))) {
+        return;
+    }
 
+    /* Filter on the raw report before any event object is built. */
+    if (!_scan_filter.match(tmp_buf, ble_scan->rssi, ble_scan->adv_data, ble_scan->adv_data_len)) {
+        return;
+    }
+
+    /* The table wants every packet, before duplicates are dropped. */
+    if (_scan_table_enabled) {
+        _scan_table.update(tmp_buf, ble_scan->addr_type, ble_scan->rssi, ble_scan->adv_data, ble_scan->adv_data_len);
+        return;
+    }
+
+    if (_scan_dedup_enabled
+     && _scan_dedup.check(ble_scan->addr, ble_scan->addr_type, ble_scan->adv_data, ble_scan->adv_data_len)) {
+        return;
+    }
+
+    if (_scan_batch_cb) {
+        uint32_t count = _scan_batch.push(tmp_buf, ble_scan->addr_type, ble_scan->rssi,
+                                          ble_scan->adv_data, ble_scan->adv_data_len);
+
+        /* One wake-up per batch, until the consumer pops it. */
+        if (count >= _scan_batch_count) {
+            Esp32AtBLE::deviceInstance().getTimerWheel().stop(&_scan_batch_timer);
+            if (_scan_batch.signal()) {
+                _scan_batch_cb(count);
+            }
+        } else if ((_scan_batch_time_ms != 0) && !_scan_batch_timer.active) {
+            Esp32AtBLE::deviceInstance().getTimerWheel().start(
+                &_scan_batch_timer, _scan_batch_time_ms, callback(this, &Esp32AtGap::scanBatchTimeoutCallback));
+        }
+        return;
+    }
+
+    if (_eventHandler) {
         peer_address_type_t peer_address_type =
             static_cast<peer_address_type_t::type>(ble_scan->addr_type);
 
@@ -492,6 +1086,22 @@ ble_error_t Esp32AtGap::connect_(
 {
     uint8_t tmp_buf[6];
 
+    /* Without a modem whitelist, scan and connect to the first listed
+     * advertiser seen. */
+    if (connectionParams.getFilter() == initiator_filter_policy_t::USE_WHITE_LIST) {
+        if (_whitelist_size == 0) {
+            return BLE_ERROR_INVALID_STATE;
+        }
+        if (!_scan) {
+            if (!_esp->ble_start_scan()) {
+                return BLE_ERROR_INVALID_STATE;
+            }
+            _connect_scan = true;
+        }
+        _connect_whitelist = true;
+        return BLE_ERROR_NONE;
+    }
+
     tmp_buf[5] = peerAddress[0];
     tmp_buf[4] = peerAddress[1];
     tmp_buf[3] = peerAddress[2];
@@ -499,15 +1109,132 @@ ble_error_t Esp32AtGap::connect_(
     tmp_buf[1] = peerAddress[4];
     tmp_buf[0] = peerAddress[5];
 
-    if (!_esp->ble_connect(0, tmp_buf)) {
+    return startConnection(tmp_buf);
+}
+
+ble_error_t Esp32AtGap::startConnection(const uint8_t * modem_addr)
+{
+    int conn_index;
+
+    conn_index = allocConnection(modem_addr);
+    if (conn_index < 0) {
+        return BLE_ERROR_NO_MEM;
+    }
+
+    /* The modem may switch role to connect. */
+    _shadow->invalidate(SHADOW_ROLE);
+
+    if (!_esp->ble_connect(conn_index, (uint8_t *)modem_addr)) {
+        _conn[conn_index].pending = false;
         return BLE_ERROR_INVALID_STATE;
     }
     return BLE_ERROR_NONE;
 }
 
+int Esp32AtGap::allocConnection(const uint8_t * modem_addr)
+{
+    conn_entry_t * p_conn;
+
+    for (int i = 0; i < ESP32AT_BLE_MAX_CONNECTIONS; i++) {
+        p_conn = &_conn[i];
+        if (!p_conn->used && !p_conn->pending) {
+            p_conn->pending    = true;
+            p_conn->pending_ms = Kernel::get_ms_count();
+            for (int j = 0; j < 6; j++) {
+                p_conn->peer[5 - j] = modem_addr[j];
+            }
+            if (!_connect_timer.active) {
+                Esp32AtBLE::deviceInstance().getTimerWheel().start(
+                    &_connect_timer, ESP32AT_BLE_CONNECT_TIMEOUT_MS, callback(this, &Esp32AtGap::connectTimeoutCallback));
+            }
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+void Esp32AtGap::connectTimeoutCallback()
+{
+    uint64_t now_ms = Kernel::get_ms_count();
+    uint32_t next_ms = 0;
+
+    for (int i = 0; i < ESP32AT_BLE_MAX_CONNECTIONS; i++) {
+        conn_entry_t * p_conn = &_conn[i];
+        uint64_t age_ms;
+
+        if (!p_conn->pending) {
+            continue;
+        }
+        age_ms = now_ms - p_conn->pending_ms;
+        if (age_ms >= ESP32AT_BLE_CONNECT_TIMEOUT_MS) {
+            p_conn->pending = false;
+            connectionFailed(BLE_ERROR_UNSPECIFIED, p_conn->peer);
+        } else if ((next_ms == 0) || ((ESP32AT_BLE_CONNECT_TIMEOUT_MS - age_ms) < next_ms)) {
+            next_ms = (uint32_t)(ESP32AT_BLE_CONNECT_TIMEOUT_MS - age_ms);
+        }
+    }
+
+    /* Never later than an attempt the handler may just have started. */
+    if (next_ms != 0) {
+        Esp32AtBLE::deviceInstance().getTimerWheel().start(
+            &_connect_timer, next_ms, callback(this, &Esp32AtGap::connectTimeoutCallback));
+    }
+}
+
+void Esp32AtGap::connectionFailed(ble_error_t status, const ble::address_t &peer)
+{
+    if (_eventHandler) {
+        _eventHandler->onConnectionComplete(
+            ConnectionCompleteEvent(
+                status,
+                (connection_handle_t)CONN_HANDLE_NONE,
+                connection_role_t::CENTRAL,
+                peer_address_type_t::ANONYMOUS,
+                peer,
+                ble::address_t(),
+                ble::address_t(),
+                conn_interval_t::max(),
+                /* dummy slave latency */ 0,
+                supervision_timeout_t::max(),
+                /* master clock accuracy */ 0
+            )
+        );
+    }
+}
+
+const Esp32AtGap::conn_entry_t * Esp32AtGap::getConnection(connection_handle_t connectionHandle) const
+{
+    if ((connectionHandle >= ESP32AT_BLE_MAX_CONNECTIONS) || !_conn[connectionHandle].used) {
+        return NULL;
+    }
+    return &_conn[connectionHandle];
+}
+
+uint32_t Esp32AtGap::getConnectionCount(void) const
+{
+    uint32_t count = 0;
+
+    for (uint32_t i = 0; i < ESP32AT_BLE_MAX_CONNECTIONS; i++) {
+        if (_conn[i].used) {
+            count++;
+        }
+    }
+
+    return count;
+}
+
 void Esp32AtGap::scanTimeoutCallback()
 {
-    if (_scan) {
+    if (_scan && (_scan_period_ms != 0)) {
+        /* End of the scan window: idle for the rest of the period. */
+        if (!_connect_whitelist) {
+            _esp->ble_stop_scan();
+        }
+        Esp32AtBLE::deviceInstance().getTimerWheel().start(
+            &_scan_period_timer, _scan_period_ms - _scan_duration_ms,
+            callback(this, &Esp32AtGap::scanPeriodCallback));
+    } else if (_scan) {
         stopScan();
         if (_eventHandler) {
             _eventHandler->onScanTimeout(ScanTimeoutEvent());
@@ -515,11 +1242,295 @@ void Esp32AtGap::scanTimeoutCallback()
     }
 }
 
+void Esp32AtGap::scanPeriodCallback()
+{
+    if (!_scan) {
+        return;
+    }
+    if (!_esp->ble_start_scan()) {
+        /* Try again in the next period rather than stop for good. */
+        Esp32AtBLE::deviceInstance().getTimerWheel().start(
+            &_scan_period_timer, _scan_period_ms, callback(this, &Esp32AtGap::scanPeriodCallback));
+        return;
+    }
+    Esp32AtBLE::deviceInstance().getTimerWheel().start(
+        &scanTimeout, _scan_duration_ms, callback(this, &Esp32AtGap::scanTimeoutCallback));
+}
+
+void Esp32AtGap::scanDedupResetCallback()
+{
+    if (_scan) {
+        _scan_dedup.clear();
+        Esp32AtBLE::deviceInstance().getTimerWheel().start(
+            &_scan_dedup_timer, _scan_dedup_reset_ms, callback(this, &Esp32AtGap::scanDedupResetCallback));
+    }
+}
+
+void Esp32AtGap::setScanBatching(
+    mbed::Callback<void(uint32_t)> cb,
+    uint32_t max_count,
+    uint32_t max_time_ms,
+    uint32_t policy
+)
+{
+    Esp32AtBLE::deviceInstance().getTimerWheel().stop(&_scan_batch_timer);
+    _scan_batch.clear();
+
+    if ((max_count == 0) || (max_count > ESP32AT_BLE_SCAN_BATCH_SIZE)) {
+        max_count = ESP32AT_BLE_SCAN_BATCH_SIZE;
+    }
+    _scan_batch_count   = max_count;
+    _scan_batch_time_ms = max_time_ms;
+    _scan_batch.setOverflowPolicy(policy);
+    _scan_batch.setThreshold(max_count);
+    _scan_batch_cb      = cb;
+}
+
+void Esp32AtGap::scanBatchTimeoutCallback()
+{
+    uint32_t count = _scan_batch.pending();
+
+    if ((count != 0) && _scan_batch_cb) {
+        _scan_batch_cb(count);
+    }
+}
+
+void Esp32AtGap::enableScanTable(
+    bool enable,
+    Esp32AtScanTable::presence_cb_t cb,
+    uint32_t timeout_ms
+)
+{
+    Esp32AtBLE::deviceInstance().getTimerWheel().stop(&_scan_table_timer);
+    _scan_table.clear();
+    _scan_table.setPresenceCallback(cb);
+    _scan_table.setTimeout(timeout_ms);
+    _scan_table_enabled = enable;
+
+    if (enable && (timeout_ms != 0)) {
+        _scan_table_sweep_ms = timeout_ms / 2;
+        if (_scan_table_sweep_ms < ESP32AT_BLE_TIMER_TICK_MS) {
+            _scan_table_sweep_ms = ESP32AT_BLE_TIMER_TICK_MS;
+        }
+        Esp32AtBLE::deviceInstance().getTimerWheel().start(
+            &_scan_table_timer, _scan_table_sweep_ms, callback(this, &Esp32AtGap::scanTableSweepCallback));
+    }
+}
+
+void Esp32AtGap::scanTableSweepCallback()
+{
+    if (_scan_table_enabled) {
+        _scan_table.expire();
+        Esp32AtBLE::deviceInstance().getTimerWheel().start(
+            &_scan_table_timer, _scan_table_sweep_ms, callback(this, &Esp32AtGap::scanTableSweepCallback));
+    }
+}
+
 void Esp32AtGap::advertisingTimeoutCallback()
 {
-    _esp->ble_stop_advertising();
+    uint64_t now_ms = Kernel::get_ms_count();
+
+    /* Shared by the duration timers of all sets. */
+    for (advertising_handle_t i = 0; i < ESP32AT_BLE_MAX_ADVERTISING_SETS; i++) {
+        if (!_adv_set[i].active || (_adv_set[i].end_ms == 0) || (_adv_set[i].end_ms > now_ms)) {
+            continue;
+        }
+        endAdvertisingSet(i);
+        if (_eventHandler) {
+            _eventHandler->onAdvertisingEnd(AdvertisingEndEvent(i, 0, advertisingEvents(i), false));
+        }
+    }
+}
+
+void Esp32AtGap::advertisingEventsCallback()
+{
+    advertising_handle_t handle = _adv_on_air;
+
+    if ((handle == ADV_SET_NONE) || (_adv_set[handle].max_events == 0)) {
+        return;
+    }
+    if (advertisingEvents(handle) < _adv_set[handle].max_events) {
+        scheduleAdvertisingEvents();
+        return;
+    }
+
+    endAdvertisingSet(handle);
     if (_eventHandler) {
-        _eventHandler->onAdvertisingEnd(AdvertisingEndEvent(advertising_handle, 0, 0, _connect));
+        _eventHandler->onAdvertisingEnd(AdvertisingEndEvent(handle, 0, advertisingEvents(handle), false));
+    }
+}
+
+ble_error_t Esp32AtGap::updateConnectionParameters_(
+    connection_handle_t connectionHandle,
+    conn_interval_t minConnectionInterval,
+    conn_interval_t maxConnectionInterval,
+    slave_latency_t slaveLatency,
+    supervision_timeout_t supervision_timeout,
+    conn_event_length_t minConnectionEventLength,
+    conn_event_length_t maxConnectionEventLength
+)
+{
+    if (getConnection(connectionHandle) == NULL) {
+        return BLE_ERROR_INVALID_STATE;
+    }
+    if (minConnectionInterval.value() > maxConnectionInterval.value()) {
+        return BLE_ERROR_INVALID_PARAM;
+    }
+
+    /* The AT command set has no connection update command. */
+    return BLE_ERROR_NOT_IMPLEMENTED;
+}
+
+ble_error_t Esp32AtGap::manageConnectionParametersUpdateRequest_(bool userManageConnectionUpdateRequest)
+{
+    /* The firmware answers update requests from the peer itself. */
+    if (userManageConnectionUpdateRequest) {
+        return BLE_ERROR_NOT_IMPLEMENTED;
+    }
+    return BLE_ERROR_NONE;
+}
+
+ble_error_t Esp32AtGap::getConnectionParameters(
+    connection_handle_t connectionHandle,
+    conn_interval_t &interval,
+    slave_latency_t &latency,
+    supervision_timeout_t &supervision_timeout
+) const
+{
+    if (getConnection(connectionHandle) == NULL) {
+        return BLE_ERROR_INVALID_PARAM;
+    }
+
+    /* The central picks them and the AT commands do not report them. */
+    return BLE_ERROR_NOT_IMPLEMENTED;
+}
+
+uint8_t Esp32AtGap::getMaxWhitelistSize_(void) const
+{
+    return ESP32AT_BLE_WHITELIST_SIZE;
+}
+
+ble_error_t Esp32AtGap::getWhitelist_(whitelist_t &whitelist) const
+{
+    uint8_t i;
+
+    for (i = 0; (i < _whitelist_size) && (i < whitelist.capacity); i++) {
+        whitelist.addresses[i] = _whitelist[i];
+    }
+    whitelist.size = i;
+
+    return BLE_ERROR_NONE;
+}
+
+ble_error_t Esp32AtGap::setWhitelist_(const whitelist_t &whitelist)
+{
+    if (whitelist.size > ESP32AT_BLE_WHITELIST_SIZE) {
+        return BLE_ERROR_PARAM_OUT_OF_RANGE;
+    }
+
+    for (uint8_t i = 0; i < whitelist.size; i++) {
+        _whitelist[i] = whitelist.addresses[i];
+    }
+    _whitelist_size = whitelist.size;
+    if (_whitelist_size == 0) {
+        stopWhitelistConnect();
+    }
+
+    return BLE_ERROR_NONE;
+}
+
+ble_error_t Esp32AtGap::addWhitelistAddress(BLEProtocol::AddressType_t type, const ble::address_t &address)
+{
+    if (whitelistContains((type == BLEProtocol::AddressType::PUBLIC) ? 0 : 1, address.data())) {
+        return BLE_ERROR_NONE;
+    }
+    if (_whitelist_size >= ESP32AT_BLE_WHITELIST_SIZE) {
+        return BLE_ERROR_NO_MEM;
+    }
+
+    _whitelist[_whitelist_size].type = type;
+    memcpy(_whitelist[_whitelist_size].address, address.data(), sizeof(BLEProtocol::AddressBytes_t));
+    _whitelist_size++;
+
+    return BLE_ERROR_NONE;
+}
+
+ble_error_t Esp32AtGap::removeWhitelistAddress(BLEProtocol::AddressType_t type, const ble::address_t &address)
+{
+    bool is_public = (type == BLEProtocol::AddressType::PUBLIC);
+
+    for (uint8_t i = 0; i < _whitelist_size; i++) {
+        if (((_whitelist[i].type == BLEProtocol::AddressType::PUBLIC) == is_public)
+         && (memcmp(_whitelist[i].address, address.data(), sizeof(BLEProtocol::AddressBytes_t)) == 0)) {
+            _whitelist_size--;
+            _whitelist[i] = _whitelist[_whitelist_size];
+            if (_whitelist_size == 0) {
+                stopWhitelistConnect();
+            }
+            return BLE_ERROR_NONE;
+        }
+    }
+
+    return BLE_ERROR_INVALID_PARAM;
+}
+
+void Esp32AtGap::stopWhitelistConnect(void)
+{
+    _connect_whitelist = false;
+    if (_connect_scan) {
+        _connect_scan = false;
+        if (!_scan) {
+            _esp->ble_stop_scan();
+        }
+    }
+}
+
+ble_error_t Esp32AtGap::cancelConnect_()
+{
+    if (!_connect_whitelist) {
+        return BLE_ERROR_INVALID_STATE;
+    }
+    stopWhitelistConnect();
+
+    return BLE_ERROR_NONE;
+}
+
+void Esp32AtGap::clearWhitelist(void)
+{
+    _whitelist_size = 0;
+    stopWhitelistConnect();
+}
+
+bool Esp32AtGap::whitelistContains(uint8_t addr_type, const uint8_t * address) const
+{
+    bool is_public = (addr_type == 0);
+
+    for (uint8_t i = 0; i < _whitelist_size; i++) {
+        if (((_whitelist[i].type == BLEProtocol::AddressType::PUBLIC) == is_public)
+         && (memcmp(_whitelist[i].address, address, sizeof(BLEProtocol::AddressBytes_t)) == 0)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void Esp32AtGap::whitelistConnect(const uint8_t * address)
+{
+    ble_error_t status;
+
+    stopWhitelistConnect();
+
+    status = startConnection(address);
+
+    /* connect() returned long ago, the failure goes to the event handler. */
+    if (status != BLE_ERROR_NONE) {
+        ble::address_t peerAddress;
+
+        for (int i = 0; i < 6; i++) {
+            peerAddress[5 - i] = address[i];
+        }
+        connectionFailed(status, peerAddress);
     }
 }
 
@@ -26,6 +26,55 @@
 #include "ble/GapScanningParams.h"
 
 #include "ESP32.h"
+#include "Esp32AtTimerWheel.h"
+#include "Esp32AtModemShadow.h"
+#include "Esp32AtAdParser.h"
+#include "Esp32AtScanDedup.h"
+#include "Esp32AtScanFilter.h"
+#include "Esp32AtScanBatch.h"
+#include "Esp32AtScanTable.h"
+
+#ifndef ESP32AT_BLE_SCAN_DEDUP_RESET_MS
+#define ESP32AT_BLE_SCAN_DEDUP_RESET_MS 1280    /* PERIODIC_RESET without a scan period */
+#endif
+
+#ifndef ESP32AT_BLE_MAX_ADVERTISING_SETS
+#define ESP32AT_BLE_MAX_ADVERTISING_SETS    4
+#endif
+
+#ifndef ESP32AT_BLE_ADV_SLOT_MS
+#define ESP32AT_BLE_ADV_SLOT_MS             200 /* time on air per turn when sets rotate */
+#endif
+
+#ifndef ESP32AT_BLE_ADV_UPDATE_INTERVAL_MS
+#define ESP32AT_BLE_ADV_UPDATE_INTERVAL_MS  50  /* minimum time between payload updates sent to the modem */
+#endif
+
+#ifndef ESP32AT_BLE_WHITELIST_SIZE
+#define ESP32AT_BLE_WHITELIST_SIZE          8
+#endif
+
+#ifndef ESP32AT_BLE_MAX_CONNECTIONS
+#define ESP32AT_BLE_MAX_CONNECTIONS         3       /* links the AT firmware supports */
+#endif
+
+/* ATT MTU of new links. The AT commands neither exchange nor report the
+ * MTU, set this to what the flashed firmware negotiates. */
+#ifndef ESP32AT_BLE_DEFAULT_ATT_MTU
+#define ESP32AT_BLE_DEFAULT_ATT_MTU         23
+#endif
+
+/* A connect() the modem never completes frees its slot after this. */
+#ifndef ESP32AT_BLE_CONNECT_TIMEOUT_MS
+#define ESP32AT_BLE_CONNECT_TIMEOUT_MS      10000
+#endif
+
+#define ESP32AT_BLE_ATT_HEADER_SIZE         3       /* opcode and handle */
+#define ESP32AT_BLE_MAX_ATTR_LEN            512
+
+#ifndef ESP32AT_BLE_SCAN_TABLE_TIMEOUT_MS
+#define ESP32AT_BLE_SCAN_TABLE_TIMEOUT_MS   10000
+#endif
 
 namespace ble {
 namespace atcmd {
@@ -91,6 +140,9 @@ public:
 
     /**
      * @see Gap::stopScan
+     *
+     * Reports stop at once; the modem keeps scanning while a whitelist
+     * connection is pending.
      */
     ble_error_t stopScan_();
 
@@ -123,6 +175,60 @@ public:
         uint8_t maxEvents = 0
     );
 
+    /** @copydoc Gap::stopAdvertising
+     */
+    ble_error_t stopAdvertising_(advertising_handle_t handle);
+
+    /** @copydoc Gap::isAdvertisingActive
+     */
+    bool isAdvertisingActive_(advertising_handle_t handle);
+
+    /** @copydoc Gap::getMaxAdvertisingSetNumber
+     */
+    uint8_t getMaxAdvertisingSetNumber_();
+
+    /** @copydoc Gap::createAdvertisingSet
+     */
+    ble_error_t createAdvertisingSet_(
+        advertising_handle_t *handle,
+        const AdvertisingParameters &parameters
+    );
+
+    /** @copydoc Gap::destroyAdvertisingSet
+     */
+    ble_error_t destroyAdvertisingSet_(advertising_handle_t handle);
+
+    /**
+     * Time an advertising set stays on air per turn while several sets
+     * are active. The modem has one advertiser, so active sets take turns.
+     */
+    ble_error_t setAdvertisingSlot(advertising_handle_t handle, uint32_t slot_ms);
+
+    /**
+     * Overwrite part of the advertising data or scan response of a set,
+     * e.g. a counter or sensor value in a beacon.
+     *
+     * The payload is not parsed again. Updates closer together than the
+     * update interval are merged and sent to the modem once the interval
+     * has passed.
+     *
+     * @param offset First byte to overwrite; the patch must lie within the
+     * current payload.
+     */
+    ble_error_t updateAdvertisingPayload(
+        advertising_handle_t handle,
+        uint32_t offset,
+        mbed::Span<const uint8_t> data,
+        bool scan_response = false
+    );
+
+    /**
+     * Minimum time between two payload updates sent to the modem.
+     */
+    void setPayloadUpdateInterval(uint32_t interval_ms) {
+        _adv_update_interval_ms = interval_ms;
+    }
+
     /**
      * @see Gap::connect
      */
@@ -132,9 +238,199 @@ public:
         const ConnectionParameters &connectionParams
     );
 
+    /** @copydoc Gap::getMaxWhitelistSize
+     */
+    uint8_t getMaxWhitelistSize_(void) const;
+
+    /** @copydoc Gap::getWhitelist
+     */
+    ble_error_t getWhitelist_(whitelist_t &whitelist) const;
+
+    /** @copydoc Gap::setWhitelist
+     */
+    ble_error_t setWhitelist_(const whitelist_t &whitelist);
+
+    /**
+     * Add one address to the whitelist.
+     */
+    ble_error_t addWhitelistAddress(BLEProtocol::AddressType_t type, const ble::address_t &address);
+
+    /**
+     * Remove one address from the whitelist.
+     */
+    ble_error_t removeWhitelistAddress(BLEProtocol::AddressType_t type, const ble::address_t &address);
+
+    /**
+     * Empty the whitelist; a pending whitelist connection is cancelled.
+     */
+    void clearWhitelist(void);
+
+    uint8_t getWhitelistSize(void) const {
+        return _whitelist_size;
+    }
+
+    /** @copydoc Gap::updateConnectionParameters
+     */
+    ble_error_t updateConnectionParameters_(
+        connection_handle_t connectionHandle,
+        conn_interval_t minConnectionInterval,
+        conn_interval_t maxConnectionInterval,
+        slave_latency_t slaveLatency,
+        supervision_timeout_t supervision_timeout,
+        conn_event_length_t minConnectionEventLength,
+        conn_event_length_t maxConnectionEventLength
+    );
+
+    /** @copydoc Gap::manageConnectionParametersUpdateRequest
+     */
+    ble_error_t manageConnectionParametersUpdateRequest_(bool userManageConnectionUpdateRequest);
+
+    typedef struct {
+        bool used;
+        bool pending;           /* connect() issued, waiting for the link */
+        connection_role_t::type role;
+        ble::address_t peer;
+        uint16_t att_mtu;
+        uint64_t pending_ms;    /* when connect() was issued */
+    } conn_entry_t;
+
+    /**
+     * Entry of a live connection, NULL if the handle is not connected.
+     * Handles are the modem's connection index.
+     */
+    const conn_entry_t * getConnection(connection_handle_t connectionHandle) const;
+
+    uint32_t getConnectionCount(void) const;
+
+    /**
+     * Link a GATT server event belongs to. The AT firmware does not tell
+     * which central wrote, the most recent peripheral link is assumed.
+     */
+    connection_handle_t getServerConnection(void) const {
+        return _conn_server;
+    }
+
+    /**
+     * ATT MTU of a link, the default MTU if the handle is not connected.
+     */
+    uint16_t getAttMtu(connection_handle_t connectionHandle) const {
+        const conn_entry_t * p_conn = getConnection(connectionHandle);
+
+        return (p_conn != NULL) ? p_conn->att_mtu : ESP32AT_BLE_DEFAULT_ATT_MTU;
+    }
+
+    /**
+     * Largest value that fits in one notification or write command. The
+     * MTU is the configured default, not learned from the link; the driver
+     * only uses it to split streams, never to cut a value.
+     */
+    uint16_t getAttPayloadSize(connection_handle_t connectionHandle) const {
+        return getAttMtu(connectionHandle) - ESP32AT_BLE_ATT_HEADER_SIZE;
+    }
+
+    /**
+     * Parameters of a connection.
+     *
+     * @return BLE_ERROR_NOT_IMPLEMENTED for a live connection, the AT
+     * commands cannot read them.
+     */
+    ble_error_t getConnectionParameters(
+        connection_handle_t connectionHandle,
+        conn_interval_t &interval,
+        slave_latency_t &latency,
+        supervision_timeout_t &supervision_timeout
+    ) const;
+
+    /** @copydoc Gap::cancelConnect
+     */
+    ble_error_t cancelConnect_();
+
     /* event process */
     void doEvent(uint32_t id, void * arg);
 
+    /**
+     * Number of scan reports dropped as duplicates since the last
+     * startScan().
+     */
+    uint32_t getSuppressedScanReports(void) const {
+        return _scan_dedup.getSuppressed();
+    }
+
+    /**
+     * Rules applied to scan reports before onAdvertisingReport.
+     */
+    Esp32AtScanFilter &getScanFilter(void) {
+        return _scan_filter;
+    }
+
+    /**
+     * Deliver scan reports in batches instead of through
+     * onAdvertisingReport.
+     *
+     * Reports are kept in a ring of ESP32AT_BLE_SCAN_BATCH_SIZE entries and
+     * taken with popScanReports(). The callback is invoked with the number
+     * of pending reports once max_count are pending, or max_time_ms after
+     * the first report of a batch arrived. A full batch is signalled once;
+     * the next signal follows after popScanReports() took enough reports.
+     *
+     * @param cb Batch callback, an empty callback turns batching off.
+     * @param max_count Batch size, 0 or more than the ring size for the
+     * ring size.
+     * @param max_time_ms Batch age limit, 0 for none.
+     * @param policy SCAN_BATCH_DROP_OLDEST or SCAN_BATCH_DROP_NEWEST.
+     */
+    void setScanBatching(
+        mbed::Callback<void(uint32_t)> cb,
+        uint32_t max_count = 0,
+        uint32_t max_time_ms = 0,
+        uint32_t policy = SCAN_BATCH_DROP_OLDEST
+    );
+
+    /**
+     * Take batched scan reports, oldest first. May be called from any
+     * thread.
+     *
+     * @return Number of reports copied.
+     */
+    uint32_t popScanReports(scan_report_t * p_reports, uint32_t max) {
+        return _scan_batch.pop(p_reports, max);
+    }
+
+    /**
+     * Number of batched scan reports lost to overflow.
+     */
+    uint32_t getDroppedScanReports(void) const {
+        return _scan_batch.getDropped();
+    }
+
+    /**
+     * Track scanned devices in a table instead of reporting every packet.
+     *
+     * While enabled, scan reports passing the scan filter update the table
+     * and onAdvertisingReport is not called; the presence callback reports
+     * arrivals and departures.
+     *
+     * @param timeout_ms A device departs when not seen for this long,
+     * 0 to only remove devices on eviction.
+     */
+    void enableScanTable(
+        bool enable,
+        Esp32AtScanTable::presence_cb_t cb = Esp32AtScanTable::presence_cb_t(),
+        uint32_t timeout_ms = ESP32AT_BLE_SCAN_TABLE_TIMEOUT_MS
+    );
+
+    Esp32AtScanTable &getScanTable(void) {
+        return _scan_table;
+    }
+
+    /**
+     * The GATT table changed; services are started again with the next
+     * advertising parameters.
+     */
+    void servicesChanged(void) {
+        _services_started = false;
+    }
+
 protected:
     // import from Gap
     friend interface::Gap<Esp32AtGap>;
@@ -154,13 +450,70 @@ protected:
 
 private:
     ESP32 *_esp;
+    Esp32AtModemShadow *_shadow;
     BLEProtocol::AddressType_t _address_type;
     address_t _address;
     bool _scan;
-    Timeout scanTimeout;
-    Timeout advertisingTimeout;
-    advertising_handle_t advertising_handle;
-    bool _connect;
+    bool _scan_dedup_enabled;
+    uint32_t _scan_dedup_reset_ms;
+    Esp32AtScanDedup _scan_dedup;
+    Esp32AtScanFilter _scan_filter;
+    Esp32AtScanBatch _scan_batch;
+    mbed::Callback<void(uint32_t)> _scan_batch_cb;
+    uint32_t _scan_batch_count;
+    uint32_t _scan_batch_time_ms;
+    Esp32AtTimerWheel::wheel_timer_t _scan_batch_timer;
+    bool _scan_table_enabled;
+    uint32_t _scan_table_sweep_ms;
+    Esp32AtScanTable _scan_table;
+    Esp32AtTimerWheel::wheel_timer_t _scan_table_timer;
+    uint32_t _scan_duration_ms;
+    uint32_t _scan_period_ms;       /* 0: single scan */
+    Esp32AtTimerWheel::wheel_timer_t _scan_period_timer;
+    Esp32AtTimerWheel::wheel_timer_t _scan_dedup_timer;
+    Esp32AtTimerWheel::wheel_timer_t scanTimeout;
+
+    typedef struct {
+        bool created;
+        bool configured;
+        bool active;
+        ESP32::advertising_param_t param;
+        uint8_t adv_data[ESP32AT_BLE_SHADOW_ADV_DATA_SIZE];
+        uint8_t adv_data_len;
+        uint8_t scan_response[ESP32AT_BLE_SHADOW_ADV_DATA_SIZE];
+        uint8_t scan_response_len;
+        char name[ESP32AT_BLE_SHADOW_ADV_DATA_SIZE];    /* from the payload, empty: keep */
+        uint32_t slot_ms;
+        uint8_t dirty;          /* ADV_DIRTY_xxx: patched, not yet sent */
+        uint64_t end_ms;        /* 0: no duration */
+        Esp32AtTimerWheel::wheel_timer_t timeout;
+        uint8_t max_events;     /* 0: no limit */
+        uint32_t events;        /* events of previous turns on air */
+        uint64_t on_air_ms;     /* start of the current turn on air */
+    } adv_set_t;
+
+    #define ADV_SET_NONE    0xFF
+    #define CONN_HANDLE_NONE    0xFFFF
+
+    #define ADV_DIRTY_DATA          (1 << 0)
+    #define ADV_DIRTY_SCAN_RESPONSE (1 << 1)
+
+    adv_set_t _adv_set[ESP32AT_BLE_MAX_ADVERTISING_SETS];
+    advertising_handle_t _adv_on_air;
+    Esp32AtTimerWheel::wheel_timer_t _adv_rotation_timer;
+    uint32_t _adv_update_interval_ms;
+    uint64_t _adv_last_update_ms;
+    Esp32AtTimerWheel::wheel_timer_t _adv_update_timer;
+    Esp32AtTimerWheel::wheel_timer_t _adv_events_timer;
+    BLEProtocol::Address_t _whitelist[ESP32AT_BLE_WHITELIST_SIZE];
+    uint8_t _whitelist_size;
+    bool _scan_whitelist;           /* scan filter policy uses the whitelist */
+    bool _connect_whitelist;        /* connect to the first whitelisted advertiser */
+    bool _connect_scan;             /* scan started for _connect_whitelist */
+    conn_entry_t _conn[ESP32AT_BLE_MAX_CONNECTIONS];
+    Esp32AtTimerWheel::wheel_timer_t _connect_timer;
+    connection_handle_t _conn_server;
+    bool _services_started;
     uint8_t randam_addr[6];
     ESP32::advertising_param_t advertising_param;
 
@@ -172,9 +525,36 @@ private:
     void ble_conn_cb(int conn_index, uint8_t * remote_addr);
     void ble_disconn_cb(int conn_index);
     void ble_scan_cb(ESP32::ble_scan_t * ble_scan);
+    int allocConnection(const uint8_t * modem_addr);
+    ble_error_t startConnection(const uint8_t * modem_addr);
+    void connectionFailed(ble_error_t status, const ble::address_t &peer);
 
     void scanTimeoutCallback();
+    void scanDedupResetCallback();
+    void scanBatchTimeoutCallback();
+    void scanTableSweepCallback();
+    void scanPeriodCallback();
     void advertisingTimeoutCallback();
+    void advertisingRotationCallback();
+    void advertisingUpdateCallback();
+    void advertisingEventsCallback();
+    void connectTimeoutCallback();
+
+    bool whitelistContains(uint8_t addr_type, const uint8_t * address) const;
+    void whitelistConnect(const uint8_t * address);
+    void stopWhitelistConnect(void);
+
+    void initAdvertisingSet(advertising_handle_t handle);
+    ble_error_t applyAdvertisingParams(const ESP32::advertising_param_t * p_param);
+    ble_error_t applyAdvertisingData(uint32_t entry, const uint8_t * data, uint32_t len);
+    ble_error_t switchAdvertisingSet(advertising_handle_t handle);
+    void endAdvertisingSet(advertising_handle_t handle);
+    void resumeAdvertising(advertising_handle_t after);
+    void scheduleAdvertisingRotation();
+    void takeAdvertisingOffAir();
+    void scheduleAdvertisingEvents();
+    uint32_t advertisingEventMs(const adv_set_t * p_set) const;
+    uint8_t advertisingEvents(advertising_handle_t handle) const;
 
     void set_randam_addr();
 };
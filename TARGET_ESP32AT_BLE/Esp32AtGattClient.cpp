@@ -66,7 +66,12 @@ Esp32AtGattClient &Esp32AtGattClient::getInstance()
 Esp32AtGattClient::Esp32AtGattClient() : _termination_callback(), _is_service_discovery(false)
 {
     _esp = ESP32::getESP32Inst();
-    _esp->ble_set_role(INIT_CLIENT_ROLE);
+    if (_esp->ble_set_role(INIT_CLIENT_ROLE)) {
+        int role = INIT_CLIENT_ROLE;
+        Esp32AtModemShadow::getInstance().update(SHADOW_ROLE, &role, sizeof(role));
+    } else {
+        Esp32AtModemShadow::getInstance().invalidate(SHADOW_ROLE);
+    }
 }
 
 bool Esp32AtGattClient::isServiceDiscoveryActive_() const
@@ -93,7 +98,7 @@ ble_error_t Esp32AtGattClient::launchServiceDiscovery_(
     const UUID& matching_characteristic_uuid
 )
 {
-    event_launchServiceDiscovery_t * param = new event_launchServiceDiscovery_t;
+    event_launchServiceDiscovery_t * param = _discovery_pool.alloc();
 
     if (param == NULL) {
         return BLE_ERROR_NO_MEM;
@@ -105,13 +110,13 @@ ble_error_t Esp32AtGattClient::launchServiceDiscovery_(
     param->matching_service_uuid        = matching_service_uuid;
     param->matching_characteristic_uuid = matching_characteristic_uuid;
 
-    if (!Esp32AtBLE::deviceInstance().setEvent(
-            EVENT_TYPE_CLIENT, EVENT_LAUNCH_SERVICE_DISCOVERY, (void *)param)) {
-        delete param;
-        return BLE_ERROR_NO_MEM;
+    ble_error_t err = Esp32AtBLE::deviceInstance().setEvent(
+        EVENT_TYPE_CLIENT, EVENT_LAUNCH_SERVICE_DISCOVERY, (void *)param);
+    if (err != BLE_ERROR_NONE) {
+        _discovery_pool.free(param);
     }
 
-    return BLE_ERROR_NONE;
+    return err;
 }
 
 ble_error_t Esp32AtGattClient::read_(
@@ -120,7 +125,7 @@ ble_error_t Esp32AtGattClient::read_(
     uint16_t offset
 ) const
 {
-    event_read_t * param = new event_read_t;
+    event_read_t * param = _read_pool.alloc();
 
     if (param == NULL) {
         return BLE_ERROR_NO_MEM;
@@ -130,13 +135,13 @@ ble_error_t Esp32AtGattClient::read_(
     param->attribute_handle             = attribute_handle;
     param->offset                       = offset;
 
-    if (!Esp32AtBLE::deviceInstance().setEvent(
-            EVENT_TYPE_CLIENT, EVENT_READ, (void *)param)) {
-        delete param;
-        return BLE_ERROR_NO_MEM;
+    ble_error_t err = Esp32AtBLE::deviceInstance().setEvent(
+        EVENT_TYPE_CLIENT, EVENT_READ, (void *)param);
+    if (err != BLE_ERROR_NONE) {
+        _read_pool.free(param);
     }
 
-    return BLE_ERROR_NONE;
+    return err;
 }
 
 ble_error_t Esp32AtGattClient::write_(
@@ -147,8 +152,13 @@ ble_error_t Esp32AtGattClient::write_(
     const uint8_t* value
 ) const
 {
-    event_write_t * param = new event_write_t;
+    event_write_t * param;
+
+    if (length > ESP32AT_BLE_MAX_ATTR_LEN) {
+        return BLE_ERROR_PARAM_OUT_OF_RANGE;
+    }
 
+    param = _write_pool.alloc();
     if (param == NULL) {
         return BLE_ERROR_NO_MEM;
     }
@@ -159,13 +169,13 @@ ble_error_t Esp32AtGattClient::write_(
     param->length                       = length;
     param->value                        = value;
 
-    if (!Esp32AtBLE::deviceInstance().setEvent(
-            EVENT_TYPE_CLIENT, EVENT_WRITE, (void *)param)) {
-        delete param;
-        return BLE_ERROR_NO_MEM;
+    ble_error_t err = Esp32AtBLE::deviceInstance().setEvent(
+        EVENT_TYPE_CLIENT, EVENT_WRITE, (void *)param);
+    if (err != BLE_ERROR_NONE) {
+        _write_pool.free(param);
     }
 
-    return BLE_ERROR_NONE;
+    return err;
 }
 
 void Esp32AtGattClient::doEvent(uint32_t id, void * arg)
@@ -173,21 +183,44 @@ void Esp32AtGattClient::doEvent(uint32_t id, void * arg)
     switch (id) {
         case EVENT_LAUNCH_SERVICE_DISCOVERY:
             _event_launchServiceDiscovery((event_launchServiceDiscovery_t *)arg);
-            delete (event_launchServiceDiscovery_t *)arg;
+            _discovery_pool.free((event_launchServiceDiscovery_t *)arg);
             break;
         case EVENT_READ:
             _event_read((event_read_t *)arg);
-            delete (event_read_t *)arg;
+            _read_pool.free((event_read_t *)arg);
             break;
         case EVENT_WRITE:
             _event_write((event_write_t *)arg);
-            delete (event_write_t *)arg;
+            _write_pool.free((event_write_t *)arg);
             break;
         default:
             break;
     }
 }
 
+bool Esp32AtGattClient::getPoolStats(uint32_t id, pool_stats_t * p_stats) const
+{
+    if (p_stats == NULL) {
+        return false;
+    }
+
+    switch (id) {
+        case EVENT_LAUNCH_SERVICE_DISCOVERY:
+            _discovery_pool.get_stats(p_stats);
+            break;
+        case EVENT_READ:
+            _read_pool.get_stats(p_stats);
+            break;
+        case EVENT_WRITE:
+            _write_pool.get_stats(p_stats);
+            break;
+        default:
+            return false;
+    }
+
+    return true;
+}
+
 void Esp32AtGattClient::_event_launchServiceDiscovery(event_launchServiceDiscovery_t * param)
 {
     ESP32::ble_primary_service_t services[8];
@@ -244,13 +277,13 @@ void Esp32AtGattClient::_event_launchServiceDiscovery(event_launchServiceDiscove
 
 void Esp32AtGattClient::_event_read(event_read_t * param)
 {
-    uint8_t * recv_buf = new uint8_t[512];
+    uint8_t * recv_buf = _read_buf;
     int32_t recv_size;
     GattReadCallbackParams response;
 
     recv_size = _esp->ble_read_characteristic(
                     param->connection_handle, ((param->attribute_handle >> 8) & 0xFF),
-                    (param->attribute_handle & 0xFF), recv_buf, 512);
+                    (param->attribute_handle & 0xFF), recv_buf, sizeof(_read_buf));
     response.connHandle = param->connection_handle;
     response.handle     = param->attribute_handle;
     response.status     = BLE_ERROR_NONE;
@@ -263,8 +296,6 @@ void Esp32AtGattClient::_event_read(event_read_t * param)
         response.error_code = 0x00;
     }
     onDataReadCallbackChain(&response);
-
-    delete [] recv_buf;
 }
 
 void Esp32AtGattClient::_event_write(event_write_t * param)
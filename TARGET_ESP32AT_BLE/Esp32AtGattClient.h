@@ -22,6 +22,23 @@
 
 #include "ble/GattClient.h"
 #include "ESP32.h"
+#include "Esp32AtObjectPool.h"
+
+#ifndef ESP32AT_BLE_CLIENT_DISCOVERY_POOL_SIZE
+#define ESP32AT_BLE_CLIENT_DISCOVERY_POOL_SIZE  2
+#endif
+
+#ifndef ESP32AT_BLE_CLIENT_READ_POOL_SIZE
+#define ESP32AT_BLE_CLIENT_READ_POOL_SIZE       8
+#endif
+
+#ifndef ESP32AT_BLE_CLIENT_WRITE_POOL_SIZE
+#define ESP32AT_BLE_CLIENT_WRITE_POOL_SIZE      8
+#endif
+
+#ifndef ESP32AT_BLE_CLIENT_READ_BUF_SIZE
+#define ESP32AT_BLE_CLIENT_READ_BUF_SIZE        512
+#endif
 
 namespace ble {
 namespace atcmd {
@@ -83,6 +100,14 @@ public:
     /* event process */
     void doEvent(uint32_t id, void * arg);
 
+    /**
+     * Usage of the request descriptor pools.
+     *
+     * @param id EVENT_LAUNCH_SERVICE_DISCOVERY, EVENT_READ or EVENT_WRITE.
+     * @return false if id is unknown.
+     */
+    bool getPoolStats(uint32_t id, pool_stats_t * p_stats) const;
+
 private:
     typedef struct {
         connection_handle_t connection_handle;
@@ -111,8 +136,12 @@ private:
     #define EVENT_WRITE                        3
 
     ESP32 *_esp;
+    mutable Esp32AtObjectPool<event_launchServiceDiscovery_t, ESP32AT_BLE_CLIENT_DISCOVERY_POOL_SIZE> _discovery_pool;
+    mutable Esp32AtObjectPool<event_read_t, ESP32AT_BLE_CLIENT_READ_POOL_SIZE> _read_pool;
+    mutable Esp32AtObjectPool<event_write_t, ESP32AT_BLE_CLIENT_WRITE_POOL_SIZE> _write_pool;
     ServiceDiscovery::TerminationCallback_t _termination_callback;
     bool _is_service_discovery;
+    uint8_t _read_buf[ESP32AT_BLE_CLIENT_READ_BUF_SIZE];
 
     Esp32AtGattClient();
     void _event_launchServiceDiscovery(event_launchServiceDiscovery_t * param);
@@ -17,7 +17,10 @@
 
 #include "Esp32AtGattServer.h"
 #include "mbed.h"
+#include "Esp32AtBLE.h"
 #include "Esp32AtGap.h"
+#include "Esp32AtModemShadow.h"
+#include "Esp32AtNotifyStream.h"
 
 Esp32AtGattServer &Esp32AtGattServer::getInstance()
 {
@@ -25,10 +28,15 @@ Esp32AtGattServer &Esp32AtGattServer::getInstance()
     return m_instance;
 }
 
-Esp32AtGattServer::Esp32AtGattServer() : characteristic_buf(NULL), characteristic_count(0)
+Esp32AtGattServer::Esp32AtGattServer() : characteristic_buf(NULL), characteristic_count(0), _stream(NULL)
 {
     _esp = ESP32::getESP32Inst();
-    _esp->ble_set_role(INIT_SERVER_ROLE);
+    if (_esp->ble_set_role(INIT_SERVER_ROLE)) {
+        int role = INIT_SERVER_ROLE;
+        ble::atcmd::Esp32AtModemShadow::getInstance().update(SHADOW_ROLE, &role, sizeof(role));
+    } else {
+        ble::atcmd::Esp32AtModemShadow::getInstance().invalidate(SHADOW_ROLE);
+    }
 }
 
 ble_error_t Esp32AtGattServer::addService_(GattService &service)
@@ -91,6 +99,13 @@ ble_error_t Esp32AtGattServer::addService_(GattService &service)
     for (int i = 0; i < service.getCharacteristicCount(); i++) {
         GattCharacteristic *p_char = service.getCharacteristic(i);
 
+        characteristic_buf[i].readable =
+            (p_char->getProperties() & GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_READ) ? true : false;
+        characteristic_buf[i].notifiable =
+            (p_char->getProperties() & (GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_NOTIFY
+                                      | GattCharacteristic::BLE_GATT_CHAR_PROPERTIES_INDICATE)) ? true : false;
+        characteristic_buf[i].stale    = false;
+
         /* Skip any incompletely defined, read-only characteristics. */
         if ((p_char->getValueAttribute().getValuePtr() == NULL) &&
             (p_char->getValueAttribute().getLength() == 0) &&
@@ -185,6 +200,7 @@ ble_error_t Esp32AtGattServer::addService_(GattService &service)
 
     _esp->ble_attach_write(callback(this, &Esp32AtGattServer::write_cb));
     _esp->ble_set_service(service_base, attListLen);
+    ble::atcmd::Esp32AtGap::getInstance().servicesChanged();
 
     delete [] service_base;
 
@@ -232,11 +248,29 @@ ble_error_t Esp32AtGattServer::write_(
         copy_len = len;
     }
     memcpy(characteristic_buf[attributeHandle].data, buffer, copy_len);
+    characteristic_buf[attributeHandle].cur_len = copy_len;
 
-    if (!_esp->ble_set_characteristic(attributeHandle + 1, 1, buffer, len)) {
-        return BLE_ERROR_PARAM_OUT_OF_RANGE;
-    }
-    if (localOnly == false) {
+    if (localOnly || !characteristic_buf[attributeHandle].notifiable) {
+        characteristic_buf[attributeHandle].stale = false;
+        if (!_esp->ble_set_characteristic(attributeHandle + 1, 1, buffer, len)) {
+            return BLE_ERROR_PARAM_OUT_OF_RANGE;
+        }
+        if (!localOnly) {
+            if (!_esp->ble_notifies_characteristic(attributeHandle + 1, 1, buffer, len)) {
+                return BLE_ERROR_PARAM_OUT_OF_RANGE;
+            }
+        }
+    } else {
+        /* Notifying does not store the value on the modem. Only a peer
+         * read can see the stored value, so readable characteristics get
+         * it later, once for a burst of notifications. */
+        if (characteristic_buf[attributeHandle].readable) {
+            characteristic_buf[attributeHandle].stale = true;
+            if (!_sync_timer.active) {
+                ble::Esp32AtBLE::deviceInstance().getTimerWheel().start(
+                    &_sync_timer, ESP32AT_BLE_NOTIFY_SYNC_MS, callback(this, &Esp32AtGattServer::syncCallback));
+            }
+        }
         if (!_esp->ble_notifies_characteristic(attributeHandle + 1, 1, buffer, len)) {
             return BLE_ERROR_PARAM_OUT_OF_RANGE;
         }
@@ -245,6 +279,24 @@ ble_error_t Esp32AtGattServer::write_(
     return BLE_ERROR_NONE;
 }
 
+void Esp32AtGattServer::syncCallback(void)
+{
+    for (uint16_t i = 0; i < characteristic_count; i++) {
+        if (!characteristic_buf[i].stale || (characteristic_buf[i].data == NULL)) {
+            continue;
+        }
+        characteristic_buf[i].stale = false;
+        if (!_esp->ble_set_characteristic(i + 1, 1, characteristic_buf[i].data, characteristic_buf[i].cur_len)) {
+            /* Keep the value pending and try again later. */
+            characteristic_buf[i].stale = true;
+            if (!_sync_timer.active) {
+                ble::Esp32AtBLE::deviceInstance().getTimerWheel().start(
+                    &_sync_timer, ESP32AT_BLE_NOTIFY_SYNC_MS, callback(this, &Esp32AtGattServer::syncCallback));
+            }
+        }
+    }
+}
+
 ble_error_t Esp32AtGattServer::write_(
     Gap::Handle_t connectionHandle, GattAttribute::Handle_t attributeHandle,
     const uint8_t buffer[], uint16_t len, bool localOnly)
@@ -258,11 +310,18 @@ void Esp32AtGattServer::write_cb(ESP32::ble_packet_t * ble_packet)
         GattWriteCallbackParams write_params;
         GattAttribute::Handle_t attributeHandle = ble_packet->char_index - 1;
 
-        write_params.connHandle = 0;
+        if ((_stream != NULL) && (attributeHandle == _stream->getRxHandle())
+         && _stream->received((const uint8_t *)ble_packet->data, ble_packet->len)) {
+            return;
+        }
+
+        write_params.connHandle = ble::atcmd::Esp32AtGap::getInstance().getServerConnection();
         write_params.handle     = attributeHandle;
         write_params.writeOp    = GattWriteCallbackParams::OP_WRITE_REQ; // ??
         write_params.offset     = 0;
         if ((characteristic_buf != NULL) && (characteristic_buf[attributeHandle].data != NULL)) {
+            /* The modem already stores what the peer wrote. */
+            characteristic_buf[attributeHandle].stale   = false;
             characteristic_buf[attributeHandle].cur_len = ble_packet->len;
             memcpy(characteristic_buf[attributeHandle].data, (uint8_t *)ble_packet->data, ble_packet->len);
             write_params.len    = characteristic_buf[attributeHandle].cur_len;
@@ -278,6 +337,12 @@ void Esp32AtGattServer::write_cb(ESP32::ble_packet_t * ble_packet)
 
 void Esp32AtGattServer::doEvent(uint32_t id, void * arg)
 {
-    // do nothing
+    switch (id) {
+        case EVENT_STREAM_FLUSH:
+            ((ble::atcmd::Esp32AtNotifyStream *)arg)->process();
+            break;
+        default:
+            break;
+    }
 }
 
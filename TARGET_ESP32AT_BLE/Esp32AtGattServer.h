@@ -24,6 +24,17 @@
 #include "GattServer.h"
 
 #include "ESP32.h"
+#include "Esp32AtTimerWheel.h"
+
+#ifndef ESP32AT_BLE_NOTIFY_SYNC_MS
+#define ESP32AT_BLE_NOTIFY_SYNC_MS      100 /* delay before a notified value is stored on the modem */
+#endif
+
+namespace ble {
+namespace atcmd {
+class Esp32AtNotifyStream;
+}
+}
 
 class Esp32AtGattServer : public ble::interface::GattServer<Esp32AtGattServer>
 {
@@ -36,6 +47,14 @@ public:
     virtual ble_error_t read_(GattAttribute::Handle_t attributeHandle, uint8_t buffer[], uint16_t *lengthP);
     virtual ble_error_t read_(Gap::Handle_t connectionHandle, GattAttribute::Handle_t attributeHandle,
                              uint8_t buffer[], uint16_t *lengthP);
+    /**
+     * Update a characteristic value and, unless localOnly, notify it.
+     *
+     * For a notify or indicate characteristic, only the notification is
+     * sent at once; the value is stored on the modem up to
+     * ESP32AT_BLE_NOTIFY_SYNC_MS later, and a peer read in between returns
+     * the previous value. Use localOnly to store a value at once.
+     */
     virtual ble_error_t write_(GattAttribute::Handle_t, const uint8_t[], uint16_t, bool localOnly = false);
     virtual ble_error_t write_(Gap::Handle_t connectionHandle, GattAttribute::Handle_t,
                               const uint8_t[], uint16_t, bool localOnly = false);
@@ -43,21 +62,35 @@ public:
     /* event process */
     void doEvent(uint32_t id, void * arg);
 
+    /**
+     * Route writes to the stream's receive characteristic to the stream,
+     * NULL to detach.
+     */
+    void attachStream(ble::atcmd::Esp32AtNotifyStream * p_stream) {
+        _stream = p_stream;
+    }
+
 private:
     typedef struct {
         uint8_t *    data;
         uint16_t     max_len;
         uint16_t     cur_len;
+        bool         readable;
+        bool         notifiable;
+        bool         stale;     /* notified, modem value not updated yet */
     } characteristic_buf_t;
 
     ESP32 *_esp;
     characteristic_buf_t * characteristic_buf;
     uint16_t characteristic_count;
+    ble::atcmd::Esp32AtNotifyStream * _stream;
+    ble::atcmd::Esp32AtTimerWheel::wheel_timer_t _sync_timer;
 
     Esp32AtGattServer();
     const Esp32AtGattServer& operator=(const Esp32AtGattServer &);
 
     void write_cb(ESP32::ble_packet_t * ble_packet);
+    void syncCallback(void);
 };
 
 #endif /* _ESP32AT_GATT_SERVER_H_ */
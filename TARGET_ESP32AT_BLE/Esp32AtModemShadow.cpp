@@ -0,0 +1,116 @@
+/*
+ * PackageLicenseDeclared: Apache-2.0
+ * Copyright (c) 2019 Renesas Electronics Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include "Esp32AtModemShadow.h"
+
+namespace ble {
+namespace atcmd {
+
+Esp32AtModemShadow &Esp32AtModemShadow::getInstance()
+{
+    static Esp32AtModemShadow m_instance;
+    return m_instance;
+}
+
+Esp32AtModemShadow::Esp32AtModemShadow() : _hits(0), _misses(0)
+{
+    setEntry(SHADOW_PUBLIC_ADDR,   _public_addr,   sizeof(_public_addr));
+    setEntry(SHADOW_OWN_ADDR,      _own_addr,      sizeof(_own_addr));
+    setEntry(SHADOW_DEVICE_NAME,   _device_name,   sizeof(_device_name));
+    setEntry(SHADOW_ROLE,          _role,          sizeof(_role));
+    setEntry(SHADOW_VERSION,       _version,       sizeof(_version));
+    setEntry(SHADOW_ADV_PARAM,     _adv_param,     sizeof(_adv_param));
+    setEntry(SHADOW_ADV_DATA,      _adv_data,      sizeof(_adv_data));
+    setEntry(SHADOW_SCAN_RESPONSE, _scan_response, sizeof(_scan_response));
+}
+
+const uint8_t * Esp32AtModemShadow::get(uint32_t entry, uint32_t * p_len)
+{
+    if ((entry >= SHADOW_ENTRY_NUM) || !_entry[entry].valid) {
+        _misses++;
+        return NULL;
+    }
+
+    _hits++;
+    if (p_len != NULL) {
+        *p_len = _entry[entry].len;
+    }
+    return _entry[entry].data;
+}
+
+bool Esp32AtModemShadow::matches(uint32_t entry, const void * data, uint32_t len)
+{
+    if ((entry >= SHADOW_ENTRY_NUM) || !_entry[entry].valid
+     || (_entry[entry].len != len) || (memcmp(_entry[entry].data, data, len) != 0)) {
+        _misses++;
+        return false;
+    }
+
+    _hits++;
+    return true;
+}
+
+void Esp32AtModemShadow::update(uint32_t entry, const void * data, uint32_t len)
+{
+    if (entry >= SHADOW_ENTRY_NUM) {
+        return;
+    }
+    if ((data == NULL) || (len > _entry[entry].max_len)) {
+        _entry[entry].valid = false;
+        return;
+    }
+
+    memcpy(_entry[entry].data, data, len);
+    _entry[entry].len   = len;
+    _entry[entry].valid = true;
+}
+
+void Esp32AtModemShadow::invalidate(uint32_t entry)
+{
+    if (entry < SHADOW_ENTRY_NUM) {
+        _entry[entry].valid = false;
+    }
+}
+
+void Esp32AtModemShadow::invalidateAll(void)
+{
+    for (int i = 0; i < SHADOW_ENTRY_NUM; i++) {
+        _entry[i].valid = false;
+    }
+}
+
+void Esp32AtModemShadow::getStats(uint32_t * p_hits, uint32_t * p_misses) const
+{
+    if (p_hits != NULL) {
+        *p_hits = _hits;
+    }
+    if (p_misses != NULL) {
+        *p_misses = _misses;
+    }
+}
+
+void Esp32AtModemShadow::setEntry(uint32_t entry, uint8_t * data, uint16_t max_len)
+{
+    _entry[entry].data    = data;
+    _entry[entry].max_len = max_len;
+    _entry[entry].len     = 0;
+    _entry[entry].valid   = false;
+}
+
+} // namespace atcmd
+} // namespace ble
@@ -0,0 +1,119 @@
+/*
+ * PackageLicenseDeclared: Apache-2.0
+ * Copyright (c) 2019 Renesas Electronics Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _ESP32AT_MODEM_SHADOW_H_
+#define _ESP32AT_MODEM_SHADOW_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ESP32.h"
+
+#ifndef ESP32AT_BLE_SHADOW_NAME_SIZE
+#define ESP32AT_BLE_SHADOW_NAME_SIZE        128
+#endif
+
+#ifndef ESP32AT_BLE_SHADOW_VERSION_SIZE
+#define ESP32AT_BLE_SHADOW_VERSION_SIZE     256
+#endif
+
+#define ESP32AT_BLE_SHADOW_ADV_DATA_SIZE    31
+
+namespace ble {
+namespace atcmd {
+
+/**
+ * Host side copy of modem state.
+ *
+ * Each entry is filled by the first query or write and then used instead
+ * of asking the modem again, or to skip a write of an unchanged value.
+ * Values that do not fit an entry are not cached.
+ */
+class Esp32AtModemShadow {
+public:
+    /* entries */
+    #define SHADOW_PUBLIC_ADDR      0   /* ble_get_addr */
+    #define SHADOW_OWN_ADDR         1   /* ble_set_addr: type, random address */
+    #define SHADOW_DEVICE_NAME      2   /* zero terminated */
+    #define SHADOW_ROLE             3
+    #define SHADOW_VERSION          4   /* zero terminated */
+    #define SHADOW_ADV_PARAM        5
+    #define SHADOW_ADV_DATA         6
+    #define SHADOW_SCAN_RESPONSE    7
+    #define SHADOW_ENTRY_NUM        8
+
+    static Esp32AtModemShadow &getInstance();
+
+    /**
+     * Cached value of an entry.
+     *
+     * @return The value, or NULL if the entry is not valid.
+     */
+    const uint8_t * get(uint32_t entry, uint32_t * p_len = NULL);
+
+    /**
+     * Check whether the modem already holds a value. A match means the
+     * write can be skipped.
+     */
+    bool matches(uint32_t entry, const void * data, uint32_t len);
+
+    /**
+     * Record a value after it was read from or written to the modem.
+     */
+    void update(uint32_t entry, const void * data, uint32_t len);
+
+    void invalidate(uint32_t entry);
+    void invalidateAll(void);
+
+    /**
+     * Number of lookups answered from the shadow and of lookups that had
+     * to go to the modem.
+     */
+    void getStats(uint32_t * p_hits, uint32_t * p_misses) const;
+
+private:
+    typedef struct {
+        uint8_t * data;
+        uint16_t  max_len;
+        uint16_t  len;
+        bool      valid;
+    } shadow_entry_t;
+
+    shadow_entry_t _entry[SHADOW_ENTRY_NUM];
+    uint32_t       _hits;
+    uint32_t       _misses;
+
+    uint8_t _public_addr[6];
+    uint8_t _own_addr[7];
+    uint8_t _device_name[ESP32AT_BLE_SHADOW_NAME_SIZE];
+    uint8_t _role[sizeof(int)];
+    uint8_t _version[ESP32AT_BLE_SHADOW_VERSION_SIZE];
+    uint8_t _adv_param[sizeof(ESP32::advertising_param_t)];
+    uint8_t _adv_data[ESP32AT_BLE_SHADOW_ADV_DATA_SIZE];
+    uint8_t _scan_response[ESP32AT_BLE_SHADOW_ADV_DATA_SIZE];
+
+    Esp32AtModemShadow();
+    Esp32AtModemShadow(Esp32AtModemShadow const &);
+    void operator=(Esp32AtModemShadow const &);
+
+    void setEntry(uint32_t entry, uint8_t * data, uint16_t max_len);
+};
+
+} // namespace atcmd
+} // namespace ble
+
+#endif /* _ESP32AT_MODEM_SHADOW_H_ */
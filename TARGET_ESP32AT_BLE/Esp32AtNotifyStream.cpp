@@ -0,0 +1,222 @@
+/*
+ * PackageLicenseDeclared: Apache-2.0
+ * Copyright (c) 2019 Renesas Electronics Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include "mbed.h"
+#include "Esp32AtNotifyStream.h"
+#include "Esp32AtBLE.h"
+#include "Esp32AtGap.h"
+
+MBED_STATIC_ASSERT((ESP32AT_BLE_STREAM_BUF_SIZE & (ESP32AT_BLE_STREAM_BUF_SIZE - 1)) == 0,
+                   "ESP32AT_BLE_STREAM_BUF_SIZE must be a power of two");
+
+#define STREAM_MASK (ESP32AT_BLE_STREAM_BUF_SIZE - 1)
+
+namespace ble {
+namespace atcmd {
+
+Esp32AtNotifyStream::Esp32AtNotifyStream() :
+    _head(0), _tail(0), _state(STREAM_CLOSED), _posted(false), _blocked(false), _discard(false), _dropped(0), _failures(0),
+    _tx_handle(0), _rx_handle(0)
+{
+    _esp = ESP32::getESP32Inst();
+}
+
+ble_error_t Esp32AtNotifyStream::open(
+    GattAttribute::Handle_t tx_handle,
+    GattAttribute::Handle_t rx_handle,
+    mbed::Callback<void(const uint8_t *, uint32_t)> rx_cb,
+    mbed::Callback<void()> writable_cb
+)
+{
+    if (_state != STREAM_CLOSED) {
+        return BLE_ERROR_INVALID_STATE;
+    }
+
+    _head        = _tail;
+    _blocked     = false;
+    _discard     = false;
+    _dropped     = 0;
+    _failures    = 0;
+    _tx_handle   = tx_handle;
+    _rx_handle   = rx_handle;
+    _rx_cb       = rx_cb;
+    _writable_cb = writable_cb;
+    Esp32AtGattServer::getInstance().attachStream(this);
+    _state       = STREAM_OPEN;
+
+    return BLE_ERROR_NONE;
+}
+
+void Esp32AtNotifyStream::close(bool discard)
+{
+    if (_state == STREAM_CLOSED) {
+        return;
+    }
+
+    _discard = discard;
+    _state   = STREAM_CLOSING;
+
+    /* The BLE thread finishes the close once the buffer is empty. */
+    post();
+}
+
+uint32_t Esp32AtNotifyStream::write(const uint8_t * data, uint32_t len)
+{
+    uint32_t space;
+    uint32_t pos;
+    uint32_t first;
+
+    if (_state != STREAM_OPEN) {
+        return 0;
+    }
+
+    space = ESP32AT_BLE_STREAM_BUF_SIZE - (_tail - _head);
+    if (len > space) {
+        /* Flag first and always post, so a drain that ran since space
+         * was read is followed by one that sees the flag. */
+        _blocked = true;
+        len = ESP32AT_BLE_STREAM_BUF_SIZE - (_tail - _head);
+        if (len == 0) {
+            post();
+            return 0;
+        }
+    }
+
+    /* Only the writer moves _tail, the copy needs no lock. */
+    pos   = _tail & STREAM_MASK;
+    first = ESP32AT_BLE_STREAM_BUF_SIZE - pos;
+    if (first > len) {
+        first = len;
+    }
+    memcpy(&_buf[pos], data, first);
+    memcpy(&_buf[0], data + first, len - first);
+    _tail += len;
+
+    post();
+
+    return len;
+}
+
+void Esp32AtNotifyStream::post(void)
+{
+    if (_posted) {
+        return;
+    }
+    _posted = true;
+    if (Esp32AtBLE::deviceInstance().setEvent(
+            EVENT_TYPE_SERVER, EVENT_STREAM_FLUSH, (void *)this, EVENT_PRIO_LOW) != BLE_ERROR_NONE) {
+        /* The low priority ring is shared with GATT client I/O; drain
+         * from the timer wheel once it had time to empty. */
+        Esp32AtBLE::deviceInstance().getTimerWheel().start(
+            &_retry_timer, ESP32AT_BLE_STREAM_RETRY_MS, callback(this, &Esp32AtNotifyStream::process));
+    }
+}
+
+void Esp32AtNotifyStream::process(void)
+{
+    Esp32AtGap &gap = Esp32AtGap::getInstance();
+    uint32_t chunk_size;
+    uint32_t len;
+    uint32_t pos;
+    uint32_t first;
+
+    _posted = false;
+    Esp32AtBLE::deviceInstance().getTimerWheel().stop(&_retry_timer);
+
+    if ((_state == STREAM_CLOSED) || (_state == STREAM_FAILED)) {
+        return;
+    }
+    if ((_state == STREAM_CLOSING) && _discard) {
+        _head = _tail;
+    }
+
+    chunk_size = gap.getAttPayloadSize(gap.getServerConnection());
+    if (chunk_size > sizeof(_chunk)) {
+        chunk_size = sizeof(_chunk);
+    }
+
+    for (uint32_t i = 0; i < ESP32AT_BLE_STREAM_CHUNKS_PER_EVENT; i++) {
+        len = _tail - _head;
+        if (len == 0) {
+            break;
+        }
+        if (len > chunk_size) {
+            len = chunk_size;
+        }
+
+        pos   = _head & STREAM_MASK;
+        first = ESP32AT_BLE_STREAM_BUF_SIZE - pos;
+        if (first > len) {
+            first = len;
+        }
+        memcpy(&_chunk[0], &_buf[pos], first);
+        memcpy(&_chunk[first], &_buf[0], len - first);
+
+        if (!_esp->ble_notifies_characteristic(_tx_handle + 1, 1, _chunk, len)) {
+            /* Keep the bytes and try again later. */
+            if (++_failures < ESP32AT_BLE_STREAM_MAX_RETRIES) {
+                Esp32AtBLE::deviceInstance().getTimerWheel().start(
+                    &_retry_timer, ESP32AT_BLE_STREAM_RETRY_MS, callback(this, &Esp32AtNotifyStream::process));
+                return;
+            }
+            if (_state != STREAM_CLOSING) {
+                /* Tell the writer; close() drops what is left. */
+                _state = STREAM_FAILED;
+                if (_writable_cb) {
+                    _writable_cb();
+                }
+                return;
+            }
+            uint32_t tail = _tail;
+
+            _dropped += tail - _head;
+            _head = tail;
+            break;
+        }
+        _failures = 0;
+        _head += len;
+    }
+
+    if (_head != _tail) {
+        post();
+    } else if (_state == STREAM_CLOSING) {
+        Esp32AtGattServer::getInstance().attachStream(NULL);
+        _state = STREAM_CLOSED;
+        return;
+    }
+
+    if (_blocked && (_state == STREAM_OPEN) && ((_tail - _head) < ESP32AT_BLE_STREAM_BUF_SIZE)) {
+        _blocked = false;
+        if (_writable_cb) {
+            _writable_cb();
+        }
+    }
+}
+
+bool Esp32AtNotifyStream::received(const uint8_t * data, uint32_t len)
+{
+    if ((_state != STREAM_OPEN) || !_rx_cb) {
+        return false;
+    }
+    _rx_cb(data, len);
+
+    return true;
+}
+
+} // namespace atcmd
+} // namespace ble
@@ -0,0 +1,162 @@
+/*
+ * PackageLicenseDeclared: Apache-2.0
+ * Copyright (c) 2019 Renesas Electronics Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _ESP32AT_NOTIFY_STREAM_H_
+#define _ESP32AT_NOTIFY_STREAM_H_
+
+#include <stdint.h>
+#include "mbed.h"
+#include "ble/GattAttribute.h"
+
+#include "ESP32.h"
+#include "Esp32AtGap.h"
+#include "Esp32AtTimerWheel.h"
+
+#ifndef ESP32AT_BLE_STREAM_BUF_SIZE
+#define ESP32AT_BLE_STREAM_BUF_SIZE         1024    /* must be a power of two */
+#endif
+
+#ifndef ESP32AT_BLE_STREAM_CHUNKS_PER_EVENT
+#define ESP32AT_BLE_STREAM_CHUNKS_PER_EVENT 4       /* notifications sent before yielding */
+#endif
+
+#ifndef ESP32AT_BLE_STREAM_RETRY_MS
+#define ESP32AT_BLE_STREAM_RETRY_MS         20      /* delay before a failed step is tried again */
+#endif
+
+#ifndef ESP32AT_BLE_STREAM_MAX_RETRIES
+#define ESP32AT_BLE_STREAM_MAX_RETRIES      5       /* failed notifications before the stream fails */
+#endif
+
+/* Esp32AtGattServer event */
+#define EVENT_STREAM_FLUSH  1
+
+namespace ble {
+namespace atcmd {
+
+/**
+ * Byte stream over a notify characteristic and a write characteristic.
+ *
+ * Written bytes are buffered and sent as notifications of one full ATT
+ * payload each, from the BLE event thread. Each notification is one AT
+ * command and does not update the stored attribute value. Bytes the peer
+ * writes to the receive characteristic go to the receive callback instead
+ * of onDataWritten.
+ *
+ * write() may be called from any thread; there is one writer.
+ */
+class Esp32AtNotifyStream {
+public:
+    Esp32AtNotifyStream();
+
+    /**
+     * Start streaming.
+     *
+     * @param tx_handle Notify characteristic carrying the stream.
+     * @param rx_handle Characteristic the peer writes to.
+     * @param rx_cb Receives data written to rx_handle, on the BLE thread.
+     * @param writable_cb Called on the BLE thread when write() accepted
+     * less than asked and space is free again, or the stream failed.
+     */
+    ble_error_t open(
+        GattAttribute::Handle_t tx_handle,
+        GattAttribute::Handle_t rx_handle,
+        mbed::Callback<void(const uint8_t *, uint32_t)> rx_cb,
+        mbed::Callback<void()> writable_cb = mbed::Callback<void()>()
+    );
+
+    /**
+     * Stop streaming. Buffered bytes are still sent unless discard is
+     * true or the stream failed; isOpen() turns false once they are.
+     */
+    void close(bool discard = false);
+
+    bool isOpen(void) const {
+        return _state != STREAM_CLOSED;
+    }
+
+    /**
+     * A notification failed ESP32AT_BLE_STREAM_MAX_RETRIES times in a row,
+     * e.g. the link dropped. Buffered bytes are kept, write() accepts no
+     * more; close() the stream. Peer writes to rx_handle are then
+     * reported through the normal onDataWritten() path.
+     */
+    bool hasFailed(void) const {
+        return _state == STREAM_FAILED;
+    }
+
+    /**
+     * Queue bytes for sending.
+     *
+     * @return Number of bytes accepted; less than len when the buffer is
+     * full, 0 when the stream is closed, closing or failed.
+     */
+    uint32_t write(const uint8_t * data, uint32_t len);
+
+    /**
+     * Bytes buffered and not yet sent.
+     */
+    uint32_t pending(void) const {
+        return _tail - _head;
+    }
+
+    /**
+     * Bytes thrown away when a failed stream was closed.
+     */
+    uint32_t getDropped(void) const {
+        return _dropped;
+    }
+
+    GattAttribute::Handle_t getRxHandle(void) const {
+        return _rx_handle;
+    }
+
+    /* called by Esp32AtGattServer */
+    void process(void);
+    /* false if not consumed: the write takes the normal path */
+    bool received(const uint8_t * data, uint32_t len);
+
+private:
+    #define STREAM_CLOSED   0
+    #define STREAM_OPEN     1
+    #define STREAM_CLOSING  2
+    #define STREAM_FAILED   3
+
+    ESP32 *_esp;
+    uint8_t           _buf[ESP32AT_BLE_STREAM_BUF_SIZE];
+    volatile uint32_t _head;
+    volatile uint32_t _tail;
+    volatile uint32_t _state;
+    volatile bool     _posted;      /* flush event queued */
+    volatile bool     _blocked;     /* a write did not fit */
+    volatile bool     _discard;     /* close() without sending the rest */
+    uint32_t          _dropped;
+    uint32_t          _failures;    /* consecutive failed notifications */
+    GattAttribute::Handle_t _tx_handle;
+    GattAttribute::Handle_t _rx_handle;
+    mbed::Callback<void(const uint8_t *, uint32_t)> _rx_cb;
+    mbed::Callback<void()> _writable_cb;
+    uint8_t           _chunk[ESP32AT_BLE_MAX_ATTR_LEN];
+    Esp32AtTimerWheel::wheel_timer_t _retry_timer;
+
+    void post(void);
+};
+
+} // namespace atcmd
+} // namespace ble
+
+#endif /* _ESP32AT_NOTIFY_STREAM_H_ */
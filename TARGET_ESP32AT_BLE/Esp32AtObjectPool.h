@@ -0,0 +1,103 @@
+/*
+ * PackageLicenseDeclared: Apache-2.0
+ * Copyright (c) 2019 Renesas Electronics Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _ESP32AT_OBJECT_POOL_H_
+#define _ESP32AT_OBJECT_POOL_H_
+
+#include <new>
+#include "mbed.h"
+
+namespace ble {
+namespace atcmd {
+
+typedef struct {
+    uint32_t used;
+    uint32_t peak;
+    uint32_t alloc_failures;
+} pool_stats_t;
+
+/**
+ * Statically sized pool of N objects of type T.
+ *
+ * Storage comes from an rtos::MemoryPool, so there is no heap traffic.
+ * alloc() and free() may be called from thread or interrupt context.
+ */
+template<typename T, uint32_t N>
+class Esp32AtObjectPool {
+public:
+    Esp32AtObjectPool() : _used(0), _peak(0), _alloc_failures(0) {
+    }
+
+    /**
+     * Take a default constructed object from the pool.
+     *
+     * @return The object, or NULL if the pool is exhausted.
+     */
+    T * alloc(void) {
+        void * p_mem = _pool.alloc();
+
+        core_util_critical_section_enter();
+        if (p_mem == NULL) {
+            _alloc_failures++;
+        } else {
+            _used++;
+            if (_used > _peak) {
+                _peak = _used;
+            }
+        }
+        core_util_critical_section_exit();
+
+        if (p_mem == NULL) {
+            return NULL;
+        }
+        return new (p_mem) T();
+    }
+
+    /**
+     * Destroy an object and return it to the pool.
+     */
+    void free(T * p_obj) {
+        if (p_obj == NULL) {
+            return;
+        }
+        p_obj->~T();
+        _pool.free(p_obj);
+
+        core_util_critical_section_enter();
+        _used--;
+        core_util_critical_section_exit();
+    }
+
+    void get_stats(pool_stats_t * p_stats) const {
+        core_util_critical_section_enter();
+        p_stats->used           = _used;
+        p_stats->peak           = _peak;
+        p_stats->alloc_failures = _alloc_failures;
+        core_util_critical_section_exit();
+    }
+
+private:
+    MemoryPool<T, N> _pool;
+    uint32_t         _used;
+    uint32_t         _peak;
+    uint32_t         _alloc_failures;
+};
+
+} // namespace atcmd
+} // namespace ble
+
+#endif /* _ESP32AT_OBJECT_POOL_H_ */
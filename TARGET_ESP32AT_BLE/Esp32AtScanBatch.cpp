@@ -0,0 +1,112 @@
+/*
+ * PackageLicenseDeclared: Apache-2.0
+ * Copyright (c) 2019 Renesas Electronics Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include "mbed.h"
+#include "Esp32AtScanBatch.h"
+
+MBED_STATIC_ASSERT((ESP32AT_BLE_SCAN_BATCH_SIZE & (ESP32AT_BLE_SCAN_BATCH_SIZE - 1)) == 0,
+                   "ESP32AT_BLE_SCAN_BATCH_SIZE must be a power of two");
+
+#define BATCH_MASK  (ESP32AT_BLE_SCAN_BATCH_SIZE - 1)
+
+namespace ble {
+namespace atcmd {
+
+Esp32AtScanBatch::Esp32AtScanBatch() : _head(0), _tail(0), _policy(SCAN_BATCH_DROP_OLDEST), _dropped(0),
+    _threshold(ESP32AT_BLE_SCAN_BATCH_SIZE), _signalled(false)
+{
+}
+
+uint32_t Esp32AtScanBatch::push(const uint8_t * addr, uint8_t addr_type, int8_t rssi, const uint8_t * data, uint32_t len)
+{
+    scan_report_t * p_report;
+    uint32_t count;
+
+    if (len > ESP32AT_BLE_SCAN_REPORT_DATA_SIZE) {
+        len = ESP32AT_BLE_SCAN_REPORT_DATA_SIZE;
+    }
+
+    core_util_critical_section_enter();
+    if ((_tail - _head) >= ESP32AT_BLE_SCAN_BATCH_SIZE) {
+        _dropped++;
+        if (_policy == SCAN_BATCH_DROP_NEWEST) {
+            count = _tail - _head;
+            core_util_critical_section_exit();
+            return count;
+        }
+        _head++;
+    }
+    p_report = &_report[_tail & BATCH_MASK];
+    memcpy(p_report->addr, addr, sizeof(p_report->addr));
+    p_report->addr_type = addr_type;
+    p_report->rssi      = rssi;
+    p_report->len       = len;
+    memcpy(p_report->data, data, len);
+    _tail++;
+    count = _tail - _head;
+    core_util_critical_section_exit();
+
+    return count;
+}
+
+uint32_t Esp32AtScanBatch::pop(scan_report_t * p_reports, uint32_t max)
+{
+    uint32_t count = 0;
+
+    core_util_critical_section_enter();
+    while ((count < max) && (_head != _tail)) {
+        p_reports[count++] = _report[_head & BATCH_MASK];
+        _head++;
+    }
+    if ((_tail - _head) < _threshold) {
+        _signalled = false;
+    }
+    core_util_critical_section_exit();
+
+    return count;
+}
+
+uint32_t Esp32AtScanBatch::pending(void) const
+{
+    return _tail - _head;
+}
+
+void Esp32AtScanBatch::clear(void)
+{
+    core_util_critical_section_enter();
+    _head = _tail;
+    _signalled = false;
+    core_util_critical_section_exit();
+}
+
+bool Esp32AtScanBatch::signal(void)
+{
+    bool result = false;
+
+    core_util_critical_section_enter();
+    if (!_signalled && ((_tail - _head) >= _threshold)) {
+        _signalled = true;
+        result = true;
+    }
+    core_util_critical_section_exit();
+
+    return result;
+}
+
+} // namespace atcmd
+} // namespace ble
@@ -0,0 +1,111 @@
+/*
+ * PackageLicenseDeclared: Apache-2.0
+ * Copyright (c) 2019 Renesas Electronics Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _ESP32AT_SCAN_BATCH_H_
+#define _ESP32AT_SCAN_BATCH_H_
+
+#include <stdint.h>
+
+#ifndef ESP32AT_BLE_SCAN_BATCH_SIZE
+#define ESP32AT_BLE_SCAN_BATCH_SIZE     16  /* must be a power of two */
+#endif
+
+#define ESP32AT_BLE_SCAN_REPORT_DATA_SIZE   31
+
+namespace ble {
+namespace atcmd {
+
+typedef struct {
+    uint8_t addr[6];        /* address_t byte order */
+    uint8_t addr_type;      /* peer_address_type_t */
+    int8_t  rssi;
+    uint8_t len;
+    uint8_t data[ESP32AT_BLE_SCAN_REPORT_DATA_SIZE];
+} scan_report_t;
+
+/* overflow policy */
+#define SCAN_BATCH_DROP_OLDEST  0
+#define SCAN_BATCH_DROP_NEWEST  1
+
+/**
+ * Ring of raw scan reports for batched delivery.
+ *
+ * push() and pop() may be called from different threads.
+ */
+class Esp32AtScanBatch {
+public:
+    Esp32AtScanBatch();
+
+    void setOverflowPolicy(uint32_t policy) {
+        _policy = policy;
+    }
+
+    /**
+     * Number of pending reports that makes a batch.
+     */
+    void setThreshold(uint32_t threshold) {
+        _threshold = threshold;
+    }
+
+    /**
+     * Claim the wake-up of a full batch.
+     *
+     * @return true once per batch when the threshold is reached; pop() and
+     * clear() rearm it when fewer reports remain pending.
+     */
+    bool signal(void);
+
+    /**
+     * Store a report. Payloads longer than a legacy advertisement are
+     * truncated.
+     *
+     * @return Number of reports pending afterwards.
+     */
+    uint32_t push(const uint8_t * addr, uint8_t addr_type, int8_t rssi, const uint8_t * data, uint32_t len);
+
+    /**
+     * Take up to max reports, oldest first.
+     *
+     * @return Number of reports copied.
+     */
+    uint32_t pop(scan_report_t * p_reports, uint32_t max);
+
+    uint32_t pending(void) const;
+
+    void clear(void);
+
+    /**
+     * Number of reports lost to overflow.
+     */
+    uint32_t getDropped(void) const {
+        return _dropped;
+    }
+
+private:
+    scan_report_t     _report[ESP32AT_BLE_SCAN_BATCH_SIZE];
+    volatile uint32_t _head;
+    volatile uint32_t _tail;
+    uint32_t          _policy;
+    uint32_t          _dropped;
+    uint32_t          _threshold;
+    volatile bool     _signalled;
+};
+
+} // namespace atcmd
+} // namespace ble
+
+#endif /* _ESP32AT_SCAN_BATCH_H_ */
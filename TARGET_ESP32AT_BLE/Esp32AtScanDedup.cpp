@@ -0,0 +1,84 @@
+/*
+ * PackageLicenseDeclared: Apache-2.0
+ * Copyright (c) 2019 Renesas Electronics Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include "mbed_assert.h"
+#include "Esp32AtScanDedup.h"
+
+MBED_STATIC_ASSERT((ESP32AT_BLE_SCAN_DEDUP_SIZE & (ESP32AT_BLE_SCAN_DEDUP_SIZE - 1)) == 0,
+                   "ESP32AT_BLE_SCAN_DEDUP_SIZE must be a power of two");
+
+#define DEDUP_MASK      (ESP32AT_BLE_SCAN_DEDUP_SIZE - 1)
+#define DEDUP_MAX_FILL  ((ESP32AT_BLE_SCAN_DEDUP_SIZE * 3) / 4)
+
+namespace ble {
+namespace atcmd {
+
+/* FNV-1a */
+static uint32_t dedup_hash(uint32_t hash, const uint8_t * data, uint32_t len)
+{
+    for (uint32_t i = 0; i < len; i++) {
+        hash ^= data[i];
+        hash *= 16777619UL;
+    }
+    return hash;
+}
+
+Esp32AtScanDedup::Esp32AtScanDedup() : _suppressed(0)
+{
+    clear();
+}
+
+bool Esp32AtScanDedup::check(const uint8_t * addr, uint8_t addr_type, const uint8_t * data, uint32_t len)
+{
+    uint32_t payload_hash = dedup_hash(2166136261UL, data, len);
+    uint32_t idx = dedup_hash(payload_hash, addr, 6) & DEDUP_MASK;
+
+    while (_entry[idx].used) {
+        if ((_entry[idx].payload_hash == payload_hash)
+         && (_entry[idx].addr_type == addr_type)
+         && (memcmp(_entry[idx].addr, addr, 6) == 0)) {
+            _suppressed++;
+            return true;
+        }
+        idx = (idx + 1) & DEDUP_MASK;
+    }
+
+    if (_count >= DEDUP_MAX_FILL) {
+        clear();
+        idx = dedup_hash(payload_hash, addr, 6) & DEDUP_MASK;
+    }
+
+    _entry[idx].payload_hash = payload_hash;
+    _entry[idx].addr_type    = addr_type;
+    memcpy(_entry[idx].addr, addr, 6);
+    _entry[idx].used         = true;
+    _count++;
+
+    return false;
+}
+
+void Esp32AtScanDedup::clear(void)
+{
+    for (int i = 0; i < ESP32AT_BLE_SCAN_DEDUP_SIZE; i++) {
+        _entry[i].used = false;
+    }
+    _count = 0;
+}
+
+} // namespace atcmd
+} // namespace ble
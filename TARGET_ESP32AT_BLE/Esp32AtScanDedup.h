@@ -0,0 +1,80 @@
+/*
+ * PackageLicenseDeclared: Apache-2.0
+ * Copyright (c) 2019 Renesas Electronics Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _ESP32AT_SCAN_DEDUP_H_
+#define _ESP32AT_SCAN_DEDUP_H_
+
+#include <stdint.h>
+
+#ifndef ESP32AT_BLE_SCAN_DEDUP_SIZE
+#define ESP32AT_BLE_SCAN_DEDUP_SIZE     64  /* must be a power of two */
+#endif
+
+namespace ble {
+namespace atcmd {
+
+/**
+ * Set of recently seen advertisers, used to drop duplicate scan reports
+ * on the host since the modem does not filter them.
+ *
+ * A report is a duplicate if the same address already advertised the same
+ * payload. Entries live in an open addressing table of
+ * ESP32AT_BLE_SCAN_DEDUP_SIZE slots; once it is three quarters full it
+ * is cleared, so a very dense environment degrades to some repeated
+ * reports rather than to lost ones.
+ */
+class Esp32AtScanDedup {
+public:
+    Esp32AtScanDedup();
+
+    /**
+     * Record a report.
+     *
+     * @return true if it was seen before and should be dropped.
+     */
+    bool check(const uint8_t * addr, uint8_t addr_type, const uint8_t * data, uint32_t len);
+
+    void clear(void);
+
+    /**
+     * Number of reports dropped as duplicates.
+     */
+    uint32_t getSuppressed(void) const {
+        return _suppressed;
+    }
+
+    void resetSuppressed(void) {
+        _suppressed = 0;
+    }
+
+private:
+    typedef struct {
+        uint32_t payload_hash;
+        uint8_t  addr[6];
+        uint8_t  addr_type;
+        bool     used;
+    } dedup_entry_t;
+
+    dedup_entry_t _entry[ESP32AT_BLE_SCAN_DEDUP_SIZE];
+    uint32_t      _count;
+    uint32_t      _suppressed;
+};
+
+} // namespace atcmd
+} // namespace ble
+
+#endif /* _ESP32AT_SCAN_DEDUP_H_ */
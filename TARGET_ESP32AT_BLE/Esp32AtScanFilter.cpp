@@ -0,0 +1,252 @@
+/*
+ * PackageLicenseDeclared: Apache-2.0
+ * Copyright (c) 2019 Renesas Electronics Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include "mbed.h"
+#include "Esp32AtScanFilter.h"
+#include "Esp32AtAdParser.h"
+
+/* AD types */
+#define AD_INCOMPLETE_UUID16    0x02
+#define AD_COMPLETE_UUID16      0x03
+#define AD_INCOMPLETE_UUID128   0x06
+#define AD_COMPLETE_UUID128     0x07
+#define AD_SHORTENED_NAME       0x08
+#define AD_COMPLETE_NAME        0x09
+#define AD_MANUFACTURER_DATA    0xFF
+
+namespace ble {
+namespace atcmd {
+
+Esp32AtScanFilter::Esp32AtScanFilter()
+{
+    clear();
+    resetStats();
+}
+
+ble_error_t Esp32AtScanFilter::addServiceUuid(const UUID &uuid)
+{
+    scan_filter_rule_t * p_rule;
+
+    if (uuid.shortOrLong() == UUID::UUID_TYPE_SHORT) {
+        p_rule = addRule(SCAN_FILTER_UUID16, 2);
+        if (p_rule == NULL) {
+            return BLE_ERROR_NO_MEM;
+        }
+        p_rule->data[0] = (uint8_t)(uuid.getShortUUID());
+        p_rule->data[1] = (uint8_t)(uuid.getShortUUID() >> 8);
+    } else {
+        p_rule = addRule(SCAN_FILTER_UUID128, UUID::LENGTH_OF_LONG_UUID);
+        if (p_rule == NULL) {
+            return BLE_ERROR_NO_MEM;
+        }
+        /* UUID keeps long UUIDs in little endian, as they appear in AD. */
+        memcpy(p_rule->data, uuid.getBaseUUID(), UUID::LENGTH_OF_LONG_UUID);
+    }
+
+    return BLE_ERROR_NONE;
+}
+
+ble_error_t Esp32AtScanFilter::addManufacturer(uint16_t company_id, const uint8_t * prefix,
+                                               const uint8_t * mask, uint8_t len)
+{
+    scan_filter_rule_t * p_rule;
+
+    if ((len > (ESP32AT_BLE_SCAN_FILTER_DATA_SIZE - 2)) || ((len != 0) && (prefix == NULL))) {
+        return BLE_ERROR_INVALID_PARAM;
+    }
+    p_rule = addRule(SCAN_FILTER_MANUFACTURER, 2 + len);
+    if (p_rule == NULL) {
+        return BLE_ERROR_NO_MEM;
+    }
+
+    p_rule->data[0] = (uint8_t)(company_id);
+    p_rule->data[1] = (uint8_t)(company_id >> 8);
+    if (len != 0) {
+        memcpy(&p_rule->data[2], prefix, len);
+        if (mask != NULL) {
+            memcpy(&p_rule->mask[2], mask, len);
+        }
+    }
+
+    return BLE_ERROR_NONE;
+}
+
+ble_error_t Esp32AtScanFilter::addNamePrefix(const char * prefix)
+{
+    scan_filter_rule_t * p_rule;
+    size_t len;
+
+    if (prefix == NULL) {
+        return BLE_ERROR_INVALID_PARAM;
+    }
+    len = strlen(prefix);
+    if (len > ESP32AT_BLE_SCAN_FILTER_DATA_SIZE) {
+        return BLE_ERROR_INVALID_PARAM;
+    }
+    p_rule = addRule(SCAN_FILTER_NAME, len);
+    if (p_rule == NULL) {
+        return BLE_ERROR_NO_MEM;
+    }
+    memcpy(p_rule->data, prefix, len);
+
+    return BLE_ERROR_NONE;
+}
+
+ble_error_t Esp32AtScanFilter::addAddress(const address_t &address)
+{
+    scan_filter_rule_t * p_rule = addRule(SCAN_FILTER_ADDRESS, address.size());
+
+    if (p_rule == NULL) {
+        return BLE_ERROR_NO_MEM;
+    }
+    memcpy(p_rule->data, address.data(), address.size());
+
+    return BLE_ERROR_NONE;
+}
+
+void Esp32AtScanFilter::clear(void)
+{
+    _rule_count = 0;
+    _kinds      = 0;
+    _min_rssi   = -128;
+}
+
+bool Esp32AtScanFilter::match(const uint8_t * address, int8_t rssi, const uint8_t * data, uint32_t len)
+{
+    uint32_t start_us = us_ticker_read();
+    bool result;
+
+    if (rssi < _min_rssi) {
+        result = false;
+    } else if (_rule_count == 0) {
+        result = true;
+    } else {
+        result = ((_kinds & (1UL << SCAN_FILTER_ADDRESS)) && matchField(SCAN_FILTER_ADDRESS, address, 6, 6))
+              || matchPayload(data, len);
+    }
+
+    uint32_t eval_us = us_ticker_read() - start_us;
+
+    _stats.evaluated++;
+    if (result) {
+        _stats.matched++;
+    }
+    _stats.eval_total_us += eval_us;
+    if (eval_us > _stats.eval_max_us) {
+        _stats.eval_max_us = eval_us;
+    }
+
+    return result;
+}
+
+void Esp32AtScanFilter::resetStats(void)
+{
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+Esp32AtScanFilter::scan_filter_rule_t * Esp32AtScanFilter::addRule(uint8_t kind, uint8_t len)
+{
+    scan_filter_rule_t * p_rule;
+
+    if (_rule_count >= ESP32AT_BLE_SCAN_FILTER_MAX_RULES) {
+        return NULL;
+    }
+
+    p_rule = &_rule[_rule_count++];
+    p_rule->kind = kind;
+    p_rule->len  = len;
+    memset(p_rule->data, 0, sizeof(p_rule->data));
+    memset(p_rule->mask, 0xFF, sizeof(p_rule->mask));
+    _kinds |= (1UL << kind);
+
+    return p_rule;
+}
+
+bool Esp32AtScanFilter::matchPayload(const uint8_t * data, uint32_t len) const
+{
+    Esp32AtAdParser parser(mbed::Span<const uint8_t>(data, len));
+    Esp32AtAdParser::ad_field_t field;
+    uint8_t kind;
+    uint32_t step;
+
+    while (parser.next(&field)) {
+        switch (field.type) {
+            case AD_INCOMPLETE_UUID16:
+            case AD_COMPLETE_UUID16:
+                kind = SCAN_FILTER_UUID16;
+                step = 2;
+                break;
+            case AD_INCOMPLETE_UUID128:
+            case AD_COMPLETE_UUID128:
+                kind = SCAN_FILTER_UUID128;
+                step = UUID::LENGTH_OF_LONG_UUID;
+                break;
+            case AD_SHORTENED_NAME:
+            case AD_COMPLETE_NAME:
+                kind = SCAN_FILTER_NAME;
+                step = 0;
+                break;
+            case AD_MANUFACTURER_DATA:
+                kind = SCAN_FILTER_MANUFACTURER;
+                step = 0;
+                break;
+            default:
+                continue;
+        }
+        if ((_kinds & (1UL << kind))
+         && matchField(kind, field.value.data(), field.value.size(), step)) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+bool Esp32AtScanFilter::matchField(uint8_t kind, const uint8_t * value, uint32_t len, uint32_t step) const
+{
+    /* step 0: the rule is a prefix of the whole value, otherwise the
+     * value is a list of step sized elements compared one by one. */
+    uint32_t elem_len = (step == 0) ? len : step;
+
+    for (uint32_t offset = 0; (offset + elem_len) <= len; offset += elem_len) {
+        for (uint32_t i = 0; i < _rule_count; i++) {
+            const scan_filter_rule_t * p_rule = &_rule[i];
+            uint32_t j;
+
+            if ((p_rule->kind != kind) || (p_rule->len > elem_len)) {
+                continue;
+            }
+            for (j = 0; j < p_rule->len; j++) {
+                if (((value[offset + j] ^ p_rule->data[j]) & p_rule->mask[j]) != 0) {
+                    break;
+                }
+            }
+            if (j == p_rule->len) {
+                return true;
+            }
+        }
+        if (step == 0) {
+            break;
+        }
+    }
+
+    return false;
+}
+
+} // namespace atcmd
+} // namespace ble
@@ -0,0 +1,132 @@
+/*
+ * PackageLicenseDeclared: Apache-2.0
+ * Copyright (c) 2019 Renesas Electronics Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _ESP32AT_SCAN_FILTER_H_
+#define _ESP32AT_SCAN_FILTER_H_
+
+#include <stdint.h>
+#include "ble/blecommon.h"
+#include "ble/UUID.h"
+
+#ifndef ESP32AT_BLE_SCAN_FILTER_MAX_RULES
+#define ESP32AT_BLE_SCAN_FILTER_MAX_RULES   8
+#endif
+
+#define ESP32AT_BLE_SCAN_FILTER_DATA_SIZE   29  /* largest AD value in a legacy payload */
+
+namespace ble {
+namespace atcmd {
+
+/**
+ * Scan report filter evaluated on the raw advertising data.
+ *
+ * A report passes if its RSSI is not below the floor and it matches at
+ * least one rule; with no rules, the RSSI floor alone decides. Address
+ * rules are checked first, the payload is then walked once and each AD
+ * field is only compared against rules of its kind.
+ */
+class Esp32AtScanFilter {
+public:
+    typedef struct {
+        uint32_t evaluated;
+        uint32_t matched;
+        uint32_t eval_max_us;
+        uint64_t eval_total_us;
+    } scan_filter_stats_t;
+
+    Esp32AtScanFilter();
+
+    /**
+     * Pass devices listing the service in a 16 or 128-bit service UUID
+     * field.
+     */
+    ble_error_t addServiceUuid(const UUID &uuid);
+
+    /**
+     * Pass devices whose manufacturer specific data has the company
+     * identifier and whose following data matches prefix under mask.
+     *
+     * @param mask NULL to compare all bits.
+     */
+    ble_error_t addManufacturer(uint16_t company_id, const uint8_t * prefix = NULL,
+                                const uint8_t * mask = NULL, uint8_t len = 0);
+
+    /**
+     * Pass devices whose shortened or complete local name starts with
+     * prefix.
+     */
+    ble_error_t addNamePrefix(const char * prefix);
+
+    /**
+     * Pass a device address.
+     */
+    ble_error_t addAddress(const address_t &address);
+
+    /**
+     * Drop reports below the RSSI, -128 to disable.
+     */
+    void setMinRssi(int8_t rssi) {
+        _min_rssi = rssi;
+    }
+
+    /**
+     * Remove all rules and the RSSI floor.
+     */
+    void clear(void);
+
+    /**
+     * Evaluate a report.
+     *
+     * @param address Advertiser address in address_t byte order.
+     */
+    bool match(const uint8_t * address, int8_t rssi, const uint8_t * data, uint32_t len);
+
+    void getStats(scan_filter_stats_t * p_stats) const {
+        *p_stats = _stats;
+    }
+
+    void resetStats(void);
+
+private:
+    #define SCAN_FILTER_UUID16          0
+    #define SCAN_FILTER_UUID128         1
+    #define SCAN_FILTER_MANUFACTURER    2
+    #define SCAN_FILTER_NAME            3
+    #define SCAN_FILTER_ADDRESS         4
+
+    typedef struct {
+        uint8_t kind;
+        uint8_t len;
+        uint8_t data[ESP32AT_BLE_SCAN_FILTER_DATA_SIZE];
+        uint8_t mask[ESP32AT_BLE_SCAN_FILTER_DATA_SIZE];
+    } scan_filter_rule_t;
+
+    scan_filter_rule_t  _rule[ESP32AT_BLE_SCAN_FILTER_MAX_RULES];
+    uint32_t            _rule_count;
+    uint32_t            _kinds;         /* bit per kind present */
+    int8_t              _min_rssi;
+    scan_filter_stats_t _stats;
+
+    scan_filter_rule_t * addRule(uint8_t kind, uint8_t len);
+    bool matchPayload(const uint8_t * data, uint32_t len) const;
+    bool matchField(uint8_t kind, const uint8_t * value, uint32_t len, uint32_t step) const;
+};
+
+} // namespace atcmd
+} // namespace ble
+
+#endif /* _ESP32AT_SCAN_FILTER_H_ */
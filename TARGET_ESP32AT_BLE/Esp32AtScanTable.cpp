@@ -0,0 +1,137 @@
+/*
+ * PackageLicenseDeclared: Apache-2.0
+ * Copyright (c) 2019 Renesas Electronics Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include "Esp32AtScanTable.h"
+
+namespace ble {
+namespace atcmd {
+
+Esp32AtScanTable::Esp32AtScanTable() : _count(0), _timeout_ms(0)
+{
+}
+
+void Esp32AtScanTable::update(const uint8_t * addr, uint8_t addr_type, int8_t rssi, const uint8_t * data, uint32_t len)
+{
+    uint64_t now_ms = Kernel::get_ms_count();
+    scan_device_t * p_device;
+    uint32_t i;
+
+    for (i = 0; i < _count; i++) {
+        if ((_device[i].addr_type == addr_type) && (memcmp(_device[i].addr, addr, 6) == 0)) {
+            break;
+        }
+    }
+
+    if (i == _count) {
+        if (_count == ESP32AT_BLE_SCAN_TABLE_SIZE) {
+            /* Full: the least recently seen device makes room. */
+            uint32_t lru = 0;
+
+            for (uint32_t j = 1; j < _count; j++) {
+                if (_device[j].last_seen_ms < _device[lru].last_seen_ms) {
+                    lru = j;
+                }
+            }
+            remove(lru);
+            i = _count;
+        }
+        p_device = &_device[i];
+        memcpy(p_device->addr, addr, 6);
+        p_device->addr_type     = addr_type;
+        p_device->first_seen_ms = now_ms;
+        p_device->packets       = 0;
+        _rssi_q4[i]             = (int32_t)rssi * 16;
+        _count++;
+    } else {
+        p_device = &_device[i];
+        _rssi_q4[i] += (((int32_t)rssi * 16) - _rssi_q4[i]) / (1 << ESP32AT_BLE_SCAN_TABLE_RSSI_SHIFT);
+    }
+
+    if (len > ESP32AT_BLE_SCAN_DEVICE_DATA_SIZE) {
+        len = ESP32AT_BLE_SCAN_DEVICE_DATA_SIZE;
+    }
+    p_device->rssi         = (int8_t)(_rssi_q4[i] / 16);
+    p_device->last_seen_ms = now_ms;
+    p_device->packets++;
+    p_device->len          = len;
+    memcpy(p_device->data, data, len);
+
+    if ((p_device->packets == 1) && _cb) {
+        _cb(SCAN_DEVICE_ARRIVED, p_device);
+    }
+}
+
+void Esp32AtScanTable::expire(void)
+{
+    uint64_t now_ms = Kernel::get_ms_count();
+    uint32_t i = 0;
+
+    if (_timeout_ms == 0) {
+        return;
+    }
+
+    while (i < _count) {
+        if ((now_ms - _device[i].last_seen_ms) >= _timeout_ms) {
+            remove(i);
+        } else {
+            i++;
+        }
+    }
+}
+
+bool Esp32AtScanTable::find(const uint8_t * addr, uint8_t addr_type, scan_device_t * p_device) const
+{
+    for (uint32_t i = 0; i < _count; i++) {
+        if ((_device[i].addr_type == addr_type) && (memcmp(_device[i].addr, addr, 6) == 0)) {
+            *p_device = _device[i];
+            return true;
+        }
+    }
+    return false;
+}
+
+bool Esp32AtScanTable::get(uint32_t index, scan_device_t * p_device) const
+{
+    if (index >= _count) {
+        return false;
+    }
+    *p_device = _device[index];
+    return true;
+}
+
+void Esp32AtScanTable::clear(void)
+{
+    _count = 0;
+}
+
+void Esp32AtScanTable::remove(uint32_t index)
+{
+    scan_device_t device = _device[index];
+
+    /* Keep the table dense; order is not significant. */
+    _count--;
+    _device[index]  = _device[_count];
+    _rssi_q4[index] = _rssi_q4[_count];
+
+    if (_cb) {
+        _cb(SCAN_DEVICE_DEPARTED, &device);
+    }
+}
+
+} // namespace atcmd
+} // namespace ble
@@ -0,0 +1,114 @@
+/*
+ * PackageLicenseDeclared: Apache-2.0
+ * Copyright (c) 2019 Renesas Electronics Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _ESP32AT_SCAN_TABLE_H_
+#define _ESP32AT_SCAN_TABLE_H_
+
+#include <stdint.h>
+#include "mbed.h"
+
+#ifndef ESP32AT_BLE_SCAN_TABLE_SIZE
+#define ESP32AT_BLE_SCAN_TABLE_SIZE         32
+#endif
+
+#ifndef ESP32AT_BLE_SCAN_TABLE_RSSI_SHIFT
+#define ESP32AT_BLE_SCAN_TABLE_RSSI_SHIFT   3   /* smoothing factor 1/8 */
+#endif
+
+#define ESP32AT_BLE_SCAN_DEVICE_DATA_SIZE   31
+
+namespace ble {
+namespace atcmd {
+
+typedef struct {
+    uint8_t  addr[6];       /* address_t byte order */
+    uint8_t  addr_type;     /* peer_address_type_t */
+    int8_t   rssi;          /* smoothed */
+    uint64_t first_seen_ms;
+    uint64_t last_seen_ms;
+    uint32_t packets;
+    uint8_t  len;           /* latest payload */
+    uint8_t  data[ESP32AT_BLE_SCAN_DEVICE_DATA_SIZE];
+} scan_device_t;
+
+/* presence events */
+#define SCAN_DEVICE_ARRIVED     0
+#define SCAN_DEVICE_DEPARTED    1
+
+/**
+ * Table of devices seen while scanning.
+ *
+ * Entries are keyed by address and type. When the table is full the
+ * least recently seen device is evicted. A device departs when it has not
+ * been seen for the timeout, or when it is evicted.
+ */
+class Esp32AtScanTable {
+public:
+    typedef mbed::Callback<void(uint32_t event, const scan_device_t * p_device)> presence_cb_t;
+
+    Esp32AtScanTable();
+
+    void setPresenceCallback(presence_cb_t cb) {
+        _cb = cb;
+    }
+
+    void setTimeout(uint32_t timeout_ms) {
+        _timeout_ms = timeout_ms;
+    }
+
+    /**
+     * Account a scan report.
+     */
+    void update(const uint8_t * addr, uint8_t addr_type, int8_t rssi, const uint8_t * data, uint32_t len);
+
+    /**
+     * Remove devices not seen for the timeout.
+     */
+    void expire(void);
+
+    /**
+     * Look a device up.
+     *
+     * @return false if it is not in the table.
+     */
+    bool find(const uint8_t * addr, uint8_t addr_type, scan_device_t * p_device) const;
+
+    /**
+     * Copy the entry at index, 0 to count() - 1.
+     */
+    bool get(uint32_t index, scan_device_t * p_device) const;
+
+    uint32_t count(void) const {
+        return _count;
+    }
+
+    void clear(void);
+
+private:
+    scan_device_t _device[ESP32AT_BLE_SCAN_TABLE_SIZE];
+    int32_t       _rssi_q4[ESP32AT_BLE_SCAN_TABLE_SIZE];   /* smoothed RSSI * 16 */
+    uint32_t      _count;
+    uint32_t      _timeout_ms;
+    presence_cb_t _cb;
+
+    void remove(uint32_t index);
+};
+
+} // namespace atcmd
+} // namespace ble
+
+#endif /* _ESP32AT_SCAN_TABLE_H_ */
@@ -0,0 +1,189 @@
+/*
+ * PackageLicenseDeclared: Apache-2.0
+ * Copyright (c) 2019 Renesas Electronics Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "Esp32AtTimerWheel.h"
+
+MBED_STATIC_ASSERT((ESP32AT_BLE_TIMER_WHEEL_SLOTS & (ESP32AT_BLE_TIMER_WHEEL_SLOTS - 1)) == 0,
+                   "ESP32AT_BLE_TIMER_WHEEL_SLOTS must be a power of two");
+
+#define TICK_US     (ESP32AT_BLE_TIMER_TICK_MS * 1000UL)
+#define SLOT_MASK   (ESP32AT_BLE_TIMER_WHEEL_SLOTS - 1)
+
+namespace ble {
+namespace atcmd {
+
+Esp32AtTimerWheel::Esp32AtTimerWheel(mbed::Callback<bool()> notify) :
+    _tick(0), _base_tick(0), _base_us(0), _active(0), _tick_pending(false),
+    _armed(false), _armed_tick(0), _notify(notify)
+{
+    for (int i = 0; i < ESP32AT_BLE_TIMER_WHEEL_SLOTS; i++) {
+        _slot[i] = NULL;
+    }
+}
+
+void Esp32AtTimerWheel::start(wheel_timer_t * p_timer, uint32_t timeout_ms, mbed::Callback<void()> cb)
+{
+    stop(p_timer);
+
+    core_util_critical_section_enter();
+    if (_active == 0) {
+        _base_tick = _tick;
+        _base_us   = us_ticker_read();
+    }
+    /* One extra tick, as the current one has already partly elapsed. */
+    p_timer->expiry = update_clock() + ((timeout_ms + ESP32AT_BLE_TIMER_TICK_MS - 1) / ESP32AT_BLE_TIMER_TICK_MS) + 1;
+    p_timer->cb     = cb;
+    p_timer->active = true;
+    p_timer->p_next = _slot[p_timer->expiry & SLOT_MASK];
+    _slot[p_timer->expiry & SLOT_MASK] = p_timer;
+    _active++;
+    if (!_armed || ((int32_t)(p_timer->expiry - _armed_tick) < 0)) {
+        arm(p_timer->expiry);
+    }
+    core_util_critical_section_exit();
+}
+
+void Esp32AtTimerWheel::stop(wheel_timer_t * p_timer)
+{
+    core_util_critical_section_enter();
+    if (p_timer->active) {
+        unlink(p_timer);
+        /* A stale expiry for a stopped timer only costs one early wakeup. */
+        if (_active == 0) {
+            _timeout.detach();
+            _armed = false;
+        }
+    }
+    core_util_critical_section_exit();
+}
+
+void Esp32AtTimerWheel::process(void)
+{
+    wheel_timer_t * p_timer;
+    mbed::Callback<void()> cb;
+
+    _tick_pending = false;
+
+    while (true) {
+        core_util_critical_section_enter();
+        if (_active == 0) {
+            core_util_critical_section_exit();
+            return;
+        }
+        if ((int32_t)(update_clock() - _tick) < 0) {
+            rearm();
+            core_util_critical_section_exit();
+            return;
+        }
+
+        for (p_timer = _slot[_tick & SLOT_MASK]; p_timer != NULL; p_timer = p_timer->p_next) {
+            if ((int32_t)(p_timer->expiry - _tick) <= 0) {
+                break;
+            }
+        }
+        if (p_timer == NULL) {
+            _tick++;
+            core_util_critical_section_exit();
+            continue;
+        }
+
+        /* One at a time: the callback may start or stop any timer. */
+        unlink(p_timer);
+        cb = p_timer->cb;
+        core_util_critical_section_exit();
+
+        cb();
+    }
+}
+
+uint32_t Esp32AtTimerWheel::update_clock(void)
+{
+    uint32_t ticks = (us_ticker_read() - _base_us) / TICK_US;
+
+    /* Keep the base recent so the microsecond counter cannot wrap past it. */
+    _base_tick += ticks;
+    _base_us   += ticks * TICK_US;
+
+    return _base_tick;
+}
+
+void Esp32AtTimerWheel::unlink(wheel_timer_t * p_timer)
+{
+    wheel_timer_t ** pp_link = &_slot[p_timer->expiry & SLOT_MASK];
+
+    while (*pp_link != NULL) {
+        if (*pp_link == p_timer) {
+            *pp_link = p_timer->p_next;
+            break;
+        }
+        pp_link = &(*pp_link)->p_next;
+    }
+    p_timer->p_next = NULL;
+    p_timer->active = false;
+    _active--;
+}
+
+/* Called in a critical section with at least one timer pending. */
+void Esp32AtTimerWheel::rearm(void)
+{
+    wheel_timer_t * p_timer;
+    uint32_t next = 0;
+    bool found = false;
+
+    for (int i = 0; i < ESP32AT_BLE_TIMER_WHEEL_SLOTS; i++) {
+        for (p_timer = _slot[i]; p_timer != NULL; p_timer = p_timer->p_next) {
+            if (!found || ((int32_t)(p_timer->expiry - next) < 0)) {
+                next  = p_timer->expiry;
+                found = true;
+            }
+        }
+    }
+    if (found) {
+        arm(next);
+    }
+}
+
+/* Called in a critical section, right after update_clock(). */
+void Esp32AtTimerWheel::arm(uint32_t tick)
+{
+    int64_t delay_us;
+
+    delay_us = ((int64_t)(int32_t)(tick - _base_tick) * TICK_US) - (uint32_t)(us_ticker_read() - _base_us);
+    if (delay_us < 0) {
+        delay_us = 0;
+    }
+    _armed      = true;
+    _armed_tick = tick;
+    _timeout.attach_us(callback(this, &Esp32AtTimerWheel::timeout_cb), (us_timestamp_t)delay_us);
+}
+
+void Esp32AtTimerWheel::timeout_cb(void)
+{
+    _armed = false;
+    if (!_tick_pending) {
+        _tick_pending = true;
+        if (!_notify()) {
+            /* Could not be queued: retry a tick later rather than stall every timer. */
+            _tick_pending = false;
+            _armed = true;
+            _timeout.attach_us(callback(this, &Esp32AtTimerWheel::timeout_cb), TICK_US);
+        }
+    }
+}
+
+} // namespace atcmd
+} // namespace ble
@@ -0,0 +1,99 @@
+/*
+ * PackageLicenseDeclared: Apache-2.0
+ * Copyright (c) 2019 Renesas Electronics Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _ESP32AT_TIMER_WHEEL_H_
+#define _ESP32AT_TIMER_WHEEL_H_
+
+#include "mbed.h"
+
+#ifndef ESP32AT_BLE_TIMER_TICK_MS
+#define ESP32AT_BLE_TIMER_TICK_MS       10
+#endif
+
+#ifndef ESP32AT_BLE_TIMER_WHEEL_SLOTS
+#define ESP32AT_BLE_TIMER_WHEEL_SLOTS   64  /* must be a power of two */
+#endif
+
+namespace ble {
+namespace atcmd {
+
+/**
+ * Software timers of the stack.
+ *
+ * Timers are kept in a hashed wheel of ESP32AT_BLE_TIMER_WHEEL_SLOTS slots
+ * with a resolution of ESP32AT_BLE_TIMER_TICK_MS. A one-shot Timeout is
+ * armed for the earliest pending expiry only, so the MCU is not woken on
+ * every tick while long timers are running. Its interrupt handler does
+ * nothing but call the notify callback, which is expected to schedule
+ * process() in thread context and return false if it could not. Expired
+ * timer callbacks therefore never run in an ISR.
+ *
+ * Timer entries are owned by the caller, so the wheel does not allocate.
+ */
+class Esp32AtTimerWheel {
+public:
+    typedef struct wheel_timer {
+        struct wheel_timer *   p_next;
+        uint32_t               expiry;      /* in ticks */
+        bool                   active;
+        mbed::Callback<void()> cb;
+
+        wheel_timer() : p_next(NULL), expiry(0), active(false) {
+        }
+    } wheel_timer_t;
+
+    Esp32AtTimerWheel(mbed::Callback<bool()> notify);
+
+    /**
+     * (Re)start a timer. Its callback is called from process() once at
+     * least timeout_ms have elapsed.
+     */
+    void start(wheel_timer_t * p_timer, uint32_t timeout_ms, mbed::Callback<void()> cb);
+
+    /**
+     * Stop a timer. Does nothing if it is not running.
+     */
+    void stop(wheel_timer_t * p_timer);
+
+    /**
+     * Run the callbacks of all expired timers. Thread context only.
+     */
+    void process(void);
+
+private:
+    wheel_timer_t *   _slot[ESP32AT_BLE_TIMER_WHEEL_SLOTS];
+    uint32_t          _tick;        /* next tick to be processed */
+    uint32_t          _base_tick;   /* clock reference, only valid while timers are pending */
+    uint32_t          _base_us;
+    uint32_t          _active;
+    volatile bool     _tick_pending;
+    bool              _armed;
+    uint32_t          _armed_tick;  /* tick the Timeout is armed for */
+    Timeout           _timeout;
+    mbed::Callback<bool()> _notify;
+
+    uint32_t update_clock(void);
+    void unlink(wheel_timer_t * p_timer);
+    void rearm(void);
+    void arm(uint32_t tick);
+    void timeout_cb(void);
+};
+
+} // namespace atcmd
+} // namespace ble
+
+#endif /* _ESP32AT_TIMER_WHEEL_H_ */
@@ -0,0 +1,194 @@
+/*
+ * PackageLicenseDeclared: Apache-2.0
+ * Copyright (c) 2019 Renesas Electronics Corporation
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ * http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Host test of Esp32AtAdParser, which only depends on mbed::Span.
+ *
+ *   g++ -I<mbed-os> -I../TARGET_ESP32AT_BLE ad_parser_test.cpp -o ad_parser_test
+ *   ./ad_parser_test
+ *
+ * Span asserts on out of range accesses, so a bounds check missing in the
+ * parser aborts the test.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "Esp32AtAdParser.h"
+
+using ble::atcmd::Esp32AtAdParser;
+
+extern "C" void mbed_assert_internal(const char *expr, const char *file, int line)
+{
+    fprintf(stderr, "ASSERT %s (%s:%d)\n", expr, file, line);
+    abort();
+}
+
+static int failures = 0;
+
+#define CHECK(cond)                                                 \
+    do {                                                            \
+        if (!(cond)) {                                              \
+            printf("FAIL %s:%d: %s\n", __FILE__, __LINE__, #cond);  \
+            failures++;                                             \
+        }                                                           \
+    } while (0)
+
+#define PAYLOAD(buf)    mbed::Span<const uint8_t>(buf, sizeof(buf))
+
+/* flags, complete local name "abcd", manufacturer data */
+static const uint8_t valid[] = {
+    0x02, 0x01, 0x06,
+    0x05, 0x09, 'a', 'b', 'c', 'd',
+    0x03, 0xFF, 0x01, 0x02
+};
+
+static void test_valid(void)
+{
+    Esp32AtAdParser parser(PAYLOAD(valid));
+    Esp32AtAdParser::ad_field_t field;
+
+    CHECK(parser.next(&field));
+    CHECK(field.type == 0x01);
+    CHECK((field.value.size() == 1) && (field.value[0] == 0x06));
+    CHECK(parser.next(&field));
+    CHECK(field.type == 0x09);
+    CHECK((field.value.size() == 4) && (field.value[3] == 'd'));
+    CHECK(parser.next(&field));
+    CHECK(field.type == 0xFF);
+    CHECK((field.value.size() == 2) && (field.value[1] == 0x02));
+    CHECK(!parser.next(&field));
+    CHECK(!parser.isMalformed());
+    CHECK(Esp32AtAdParser::isValid(PAYLOAD(valid)));
+}
+
+static void test_empty(void)
+{
+    Esp32AtAdParser parser((mbed::Span<const uint8_t>()));
+    Esp32AtAdParser::ad_field_t field;
+
+    CHECK(!parser.next(&field));
+    CHECK(!parser.isMalformed());
+    CHECK(Esp32AtAdParser::isValid(mbed::Span<const uint8_t>()));
+}
+
+static void test_type_only(void)
+{
+    static const uint8_t payload[] = { 0x01, 0x09 };
+    Esp32AtAdParser parser(PAYLOAD(payload));
+    Esp32AtAdParser::ad_field_t field;
+
+    CHECK(parser.next(&field));
+    CHECK(field.type == 0x09);
+    CHECK(field.value.size() == 0);
+    CHECK(!parser.next(&field));
+    CHECK(!parser.isMalformed());
+}
+
+static void test_zero_length_ends_payload(void)
+{
+    /* What follows the zero length octet is padding, even if malformed. */
+    static const uint8_t payload[] = { 0x02, 0x01, 0x06, 0x00, 0x09, 0x09, 'x' };
+    Esp32AtAdParser parser(PAYLOAD(payload));
+    Esp32AtAdParser::ad_field_t field;
+
+    CHECK(parser.next(&field));
+    CHECK(!parser.next(&field));
+    CHECK(!parser.isMalformed());
+    CHECK(Esp32AtAdParser::isValid(PAYLOAD(payload)));
+}
+
+static void test_length_past_end(void)
+{
+    static const uint8_t payload[] = { 0x02, 0x01, 0x06, 0x05, 0x09, 'a', 'b' };
+    Esp32AtAdParser parser(PAYLOAD(payload));
+    Esp32AtAdParser::ad_field_t field;
+
+    CHECK(parser.next(&field));
+    CHECK(!parser.next(&field));
+    CHECK(parser.isMalformed());
+    /* Iteration stays stopped. */
+    CHECK(!parser.next(&field));
+    CHECK(!Esp32AtAdParser::isValid(PAYLOAD(payload)));
+
+    parser.reset();
+    CHECK(!parser.isMalformed());
+    CHECK(parser.next(&field));
+    CHECK(field.type == 0x01);
+}
+
+static void test_length_octet_last(void)
+{
+    static const uint8_t payload[] = { 0x02, 0x01, 0x06, 0x03 };
+    Esp32AtAdParser parser(PAYLOAD(payload));
+    Esp32AtAdParser::ad_field_t field;
+
+    CHECK(parser.next(&field));
+    CHECK(!parser.next(&field));
+    CHECK(parser.isMalformed());
+}
+
+static void test_max_length(void)
+{
+    static const uint8_t payload[] = { 0xFF, 0xFF, 0x01 };
+
+    CHECK(!Esp32AtAdParser::isValid(PAYLOAD(payload)));
+}
+
+static void test_truncated(void)
+{
+    /* Every prefix is valid exactly when it ends on a field boundary. */
+    for (size_t len = 0; len <= sizeof(valid); len++) {
+        bool boundary = (len == 0) || (len == 3) || (len == 9) || (len == sizeof(valid));
+
+        CHECK(Esp32AtAdParser::isValid(mbed::Span<const uint8_t>(valid, len)) == boundary);
+    }
+}
+
+static void test_find(void)
+{
+    static const uint8_t malformed[] = { 0x02, 0x01, 0x06, 0x09, 0xFF, 0x01 };
+    Esp32AtAdParser::ad_field_t field;
+
+    CHECK(Esp32AtAdParser::find(PAYLOAD(valid), 0x09, &field));
+    CHECK((field.value.size() == 4) && (field.value[0] == 'a'));
+    CHECK(Esp32AtAdParser::find(PAYLOAD(valid), 0xFF, &field));
+    CHECK(!Esp32AtAdParser::find(PAYLOAD(valid), 0x16, &field));
+    CHECK(Esp32AtAdParser::find(PAYLOAD(malformed), 0x01, &field));
+    /* A field running past the end is never returned. */
+    CHECK(!Esp32AtAdParser::find(PAYLOAD(malformed), 0xFF, &field));
+    CHECK(!Esp32AtAdParser::find(mbed::Span<const uint8_t>(), 0x01, &field));
+}
+
+int main(void)
+{
+    test_valid();
+    test_empty();
+    test_type_only();
+    test_zero_length_ends_payload();
+    test_length_past_end();
+    test_length_octet_last();
+    test_max_length();
+    test_truncated();
+    test_find();
+
+    if (failures != 0) {
+        printf("%d check(s) failed\n", failures);
+        return 1;
+    }
+    printf("OK\n");
+    return 0;
+}